@@ -0,0 +1,565 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "canny.hpp"
+#include "convolute.hpp"
+#include "gaussian.hpp"
+#include "grayscale.hpp"
+#include "harris.hpp"
+#include "img.hpp"
+#include "preview.hpp"
+#include "pyramid.hpp"
+#include "median.hpp"
+#include "morphology.hpp"
+#include "labeling.hpp"
+#include "distance_transform.hpp"
+#include "equalize.hpp"
+#include "hough.hpp"
+#include "resize.hpp"
+#include "template_match.hpp"
+#include "integral_image.hpp"
+#include "mat.hpp"
+#include "mat_view_2d.hpp"
+#include "sobel.hpp"
+
+namespace {
+
+struct Options {
+  unsigned width = 640;
+  unsigned height = 480;
+  unsigned repetitions = 7;
+  unsigned seed = 42;
+  bool json = false;
+  std::string filter;
+};
+
+struct Result {
+  std::string name;
+  size_t pixels;
+  size_t bytes;
+  std::vector<double> samples;  // seconds
+
+  double min() const {
+    return *std::min_element(samples.begin(), samples.end());
+  }
+
+  double median() const {
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    const auto mid = sorted.size() / 2;
+    return sorted.size() % 2 ? sorted[mid]
+                             : (sorted[mid - 1] + sorted[mid]) / 2;
+  }
+};
+
+// Keeps the optimizer from discarding the result of a benchmarked call.
+template <typename T>
+void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Makes a deterministic synthetic image: a smooth diagonal gradient with a
+ * few hard-edged rectangles and some noise, so that the edge and corner
+ * detectors have something to find.
+ */
+Mat<uint8_t> makeImage(const Options& options, unsigned channels) {
+  const unsigned height = options.height;
+  const unsigned width = options.width;
+  std::mt19937 rng(options.seed);
+  std::uniform_int_distribution<int> noise(-8, 8);
+
+  Mat<uint8_t> image({ height, width, channels });
+  unsigned index = 0;
+  for (unsigned y = 0; y < height; ++y) {
+    for (unsigned x = 0; x < width; ++x) {
+      const bool inBox = ((x / 64) + (y / 64)) % 3 == 0;
+      for (unsigned c = 0; c < channels; ++c) {
+        int value = (x + y + c * 40) * 255 / (width + height);
+        value = inBox ? 255 - value : value;
+        value = clamp(value + noise(rng), 0, 255);
+        image(index, value);
+        ++index;
+      }
+    }
+  }
+  return image;
+}
+
+class Runner {
+ public:
+  explicit Runner(const Options& options) : mOptions(options) {}
+
+  /**
+   * Times `fn` over the configured number of repetitions, after one untimed
+   * warm-up call.
+   *
+   * @param pixels Number of pixels processed by one call
+   * @param bytes Number of bytes read plus written by one call
+   */
+  void run(const std::string& name,
+           size_t pixels,
+           size_t bytes,
+           const std::function<void()>& fn) {
+    if (!mOptions.filter.empty() &&
+        name.find(mOptions.filter) == std::string::npos) {
+      return;
+    }
+    fn();
+
+    Result result{ name, pixels, bytes, {} };
+    for (unsigned i = 0; i < mOptions.repetitions; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      fn();
+      const auto end = std::chrono::steady_clock::now();
+      result.samples.push_back(
+          std::chrono::duration<double>(end - start).count());
+    }
+    if (!mOptions.json) {
+      print(result);
+    }
+    mResults.push_back(std::move(result));
+  }
+
+  void printJson(const MatPoolStats& pool) const {
+    std::cout << "{\n"
+              << "  \"width\": " << mOptions.width << ",\n"
+              << "  \"height\": " << mOptions.height << ",\n"
+              << "  \"repetitions\": " << mOptions.repetitions << ",\n"
+              << "  \"pool\": {\"hits\": " << pool.hits
+              << ", \"misses\": " << pool.misses
+              << ", \"high_water_mark\": " << pool.highWaterMark << "},\n"
+              << "  \"results\": [";
+    for (unsigned i = 0; i < mResults.size(); ++i) {
+      const auto& r = mResults[i];
+      std::cout << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\""
+                << ", \"pixels\": " << r.pixels << ", \"bytes\": " << r.bytes
+                << ", \"min_ns_per_pixel\": " << nsPerPixel(r, r.min())
+                << ", \"median_ns_per_pixel\": " << nsPerPixel(r, r.median())
+                << ", \"min_gb_per_s\": " << gbPerSecond(r, r.min())
+                << ", \"median_gb_per_s\": " << gbPerSecond(r, r.median())
+                << "}";
+    }
+    std::cout << "\n  ]\n}\n";
+  }
+
+  void printHeader() const {
+    std::cout << "Image: " << mOptions.width << "x" << mOptions.height
+              << ", repetitions: " << mOptions.repetitions << "\n\n"
+              << std::left << std::setw(32) << "benchmark" << std::right
+              << std::setw(12) << "min ns/px" << std::setw(12) << "med ns/px"
+              << std::setw(12) << "min GB/s" << std::setw(12) << "med GB/s"
+              << '\n';
+  }
+
+ private:
+  static double nsPerPixel(const Result& r, double seconds) {
+    return seconds * 1e9 / r.pixels;
+  }
+
+  static double gbPerSecond(const Result& r, double seconds) {
+    return r.bytes / seconds / 1e9;
+  }
+
+  static void print(const Result& r) {
+    std::cout << std::left << std::setw(32) << r.name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12)
+              << nsPerPixel(r, r.min()) << std::setw(12)
+              << nsPerPixel(r, r.median()) << std::setw(12)
+              << gbPerSecond(r, r.min()) << std::setw(12)
+              << gbPerSecond(r, r.median()) << std::endl;
+  }
+
+  Options mOptions;
+  std::vector<Result> mResults;
+};
+
+Mat<double> boxKernal(unsigned rows, unsigned cols) {
+  return Mat<double>({ rows, cols }, [rows, cols](unsigned) -> double {
+    return 1.0 / (rows * cols);
+  });
+}
+
+void benchMat(Runner& runner, const Mat<uint8_t>& rgb) {
+  const auto height = img::height(rgb);
+  const auto width = img::width(rgb);
+  const auto channels = img::channel(rgb);
+  const auto pixels = height * width;
+
+  runner.run("mat/accessor_read", pixels, rgb.size(), [&] {
+    unsigned sum = 0;
+    for (unsigned y = 0; y < height; ++y) {
+      for (unsigned x = 0; x < width; ++x) {
+        for (unsigned c = 0; c < channels; ++c) {
+          sum += rgb[y][x][c];
+        }
+      }
+    }
+    doNotOptimize(sum);
+  });
+
+  Mat<uint8_t> out({ height, width, channels });
+  runner.run("mat/accessor_write", pixels, out.size(), [&] {
+    for (unsigned y = 0; y < height; ++y) {
+      for (unsigned x = 0; x < width; ++x) {
+        for (unsigned c = 0; c < channels; ++c) {
+          out[y][x][c] = x + y + c;
+        }
+      }
+    }
+    doNotOptimize(out);
+  });
+
+  runner.run("mat/linear_read", pixels, rgb.size(), [&] {
+    unsigned sum = 0;
+    for (unsigned i = 0; i < rgb.size(); ++i) {
+      sum += rgb(i);
+    }
+    doNotOptimize(sum);
+  });
+
+  runner.run("mat/copy", pixels, 2 * rgb.size(), [&] {
+    Mat<uint8_t> cpy = rgb;
+    doNotOptimize(cpy);
+  });
+
+  const auto a = rgb.clone<double>();
+  const auto b = rgb.clone<double>();
+  const auto c = rgb.clone<double>();
+  Mat<double> result = a;
+  runner.run("mat/expr_fused", pixels, 4 * a.size() * sizeof(double), [&] {
+    result = abs(a + b * 0.5 - c);
+    doNotOptimize(result);
+  });
+}
+
+void benchConvolute(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = gray.size();
+  const auto asDouble = gray.clone<double>();
+
+  for (unsigned k : { 3u, 5u, 7u, 9u }) {
+    const auto kernal = boxKernal(k, k);
+    const auto suffix = std::to_string(k) + "x" + std::to_string(k);
+
+    runner.run("convolute/uint8/" + suffix, pixels, 2 * pixels, [&] {
+      doNotOptimize(convolute(gray, kernal));
+    });
+    runner.run("convolute/double/" + suffix, pixels, 16 * pixels, [&] {
+      doNotOptimize(convolute(asDouble, kernal));
+    });
+  }
+
+  // Where fft::MIN_TAPS comes from
+  for (auto [rows, cols] :
+       { std::pair{ 1u, 3u }, std::pair{ 3u, 1u }, std::pair{ 1u, 5u },
+         std::pair{ 3u, 3u }, std::pair{ 1u, 15u }, std::pair{ 5u, 5u },
+         std::pair{ 7u, 7u }, std::pair{ 9u, 9u }, std::pair{ 11u, 11u },
+         std::pair{ 15u, 15u }, std::pair{ 31u, 31u } }) {
+    const auto kernal = boxKernal(rows, cols);
+    const auto suffix = std::to_string(rows) + "x" + std::to_string(cols);
+    runner.run("convolute/direct/" + suffix, pixels, 2 * pixels, [&] {
+      doNotOptimize(directConvolute(gray, kernal));
+    });
+    runner.run("convolute/fft/" + suffix, pixels, 2 * pixels, [&] {
+      doNotOptimize(fftConvolute(gray, kernal));
+    });
+  }
+
+  std::vector<Mat<double>> bank;
+  for (unsigned k = 0; k < 8; ++k) {
+    bank.push_back(boxKernal(15, 15));
+  }
+  runner.run("convolute/bank_8x15x15", pixels, 9 * pixels, [&] {
+    doNotOptimize(convoluteBank(gray, bank));
+  });
+}
+
+void benchFilters(Runner& runner, const Mat<uint8_t>& rgb, Mat<uint8_t>& gray) {
+  const auto pixels = gray.size();
+
+  runner.run("grayscale", pixels, rgb.size() + pixels,
+             [&] { doNotOptimize(grayscale(rgb)); });
+  runner.run("gaussian", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussian(gray)); });
+  runner.run("gaussianX", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussianX(gray)); });
+  runner.run("gaussianY", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussianY(gray)); });
+  runner.run("gaussianXX", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussianXX(gray)); });
+  runner.run("gaussianYY", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussianYY(gray)); });
+  runner.run("gaussian2nd", pixels, 2 * pixels,
+             [&] { doNotOptimize(gaussian2nd(gray)); });
+  runner.run("sobel", pixels, 2 * pixels, [&] { doNotOptimize(sobel(gray)); });
+  runner.run("canny", pixels, 2 * pixels,
+             [&] { doNotOptimize(canny(gray, 50, 180)); });
+  runner.run("canny/auto_percentile", pixels, 2 * pixels,
+             [&] { doNotOptimize(canny(gray)); });
+  CannyAutoOptions otsu;
+  otsu.method = CannyAutoOptions::Method::OTSU;
+  runner.run("canny/auto_otsu", pixels, 2 * pixels,
+             [&] { doNotOptimize(canny(gray, otsu)); });
+  runner.run("harris", pixels, pixels, [&] { doNotOptimize(harris(gray)); });
+  for (const auto& [name, score] :
+       { std::pair{ "corner/harris", CornerScore::HARRIS },
+         std::pair{ "corner/shi_tomasi", CornerScore::SHI_TOMASI },
+         std::pair{ "corner/noble", CornerScore::NOBLE } }) {
+    CornerOptions options;
+    options.score = score;
+    runner.run(name, pixels, pixels + pixels * sizeof(float),
+               [&] { doNotOptimize(cornerResponse(gray, options)); });
+  }
+
+  const auto tableBytes = pixels + pixels * sizeof(int64_t);
+  runner.run("integral_image", pixels, tableBytes, [&] {
+    MatView2D<uint8_t> view(gray);
+    IntegralImage table(view);
+    doNotOptimize(table);
+  });
+
+  auto half = Mat<uint8_t>::uninitialized(
+      { (img::height(gray) + 1) / 2, (img::width(gray) + 1) / 2, 1 });
+  runner.run("pyramid/down", pixels, pixels + half.size(),
+             [&] { pyramidDown(gray, half); });
+  runner.run("pyramid/build", pixels, 2 * pixels,
+             [&] { doNotOptimize(ImagePyramid(gray).levels()); });
+}
+
+void benchResize(Runner& runner, const Mat<uint8_t>& rgb) {
+  const auto pixels = img::height(rgb) * img::width(rgb);
+  const unsigned height = img::height(rgb);
+  const unsigned width = img::width(rgb);
+  const auto rgbFloat = rgb.convertTo<float>();
+
+  const std::pair<const char*, img::Interpolation> modes[] = {
+    { "nearest", img::Interpolation::NEAREST },
+    { "bilinear", img::Interpolation::BILINEAR },
+    { "area", img::Interpolation::AREA },
+  };
+  for (const auto& [name, mode] : modes) {
+    const std::string prefix = std::string("resize/") + name;
+    runner.run(prefix + "_half", pixels, rgb.size(), [&, mode = mode] {
+      doNotOptimize(img::resize(rgb, height / 2, width / 2, mode));
+    });
+    runner.run(prefix + "_quarter", pixels, rgb.size(), [&, mode = mode] {
+      doNotOptimize(img::resize(rgb, height / 4, width / 4, mode));
+    });
+  }
+  runner.run("resize/bilinear_double", pixels, 4 * rgb.size(), [&] {
+    doNotOptimize(img::resize(rgb, height * 2, width * 2));
+  });
+  runner.run("resize/bilinear_half_float", pixels, rgbFloat.size() * 4, [&] {
+    doNotOptimize(img::resize(rgbFloat, height / 2, width / 2));
+  });
+}
+
+void benchMedian(Runner& runner,
+                 const Mat<uint8_t>& rgb,
+                 const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  for (unsigned radius : { 1u, 2u, 5u, 20u }) {
+    const std::string side = std::to_string(2 * radius + 1);
+    runner.run("median/" + side + "x" + side, pixels, 2 * gray.size(),
+               [&] { doNotOptimize(median(gray, radius)); });
+  }
+  runner.run("median/5x5_rgb", pixels, 2 * rgb.size(),
+             [&] { doNotOptimize(median(rgb, 2)); });
+}
+
+void benchMorphology(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  for (unsigned side : { 3u, 9u, 15u, 51u }) {
+    const std::string name = std::to_string(side) + "x" + std::to_string(side);
+    runner.run("morphology/dilate_" + name, pixels, 2 * gray.size(), [&] {
+      doNotOptimize(dilate(gray, StructuringElement::rect(side, side)));
+    });
+  }
+  runner.run("morphology/open_line_15", pixels, 4 * gray.size(), [&] {
+    doNotOptimize(opening(gray, StructuringElement::horizontal(15)));
+  });
+  runner.run("morphology/close_5x5", pixels, 4 * gray.size(), [&] {
+    doNotOptimize(closing(gray, StructuringElement::rect(5, 5)));
+  });
+}
+
+void benchLabeling(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  const Mat<uint8_t> mask = gray > 128;
+  runner.run("labeling/8_connected", pixels, 5 * mask.size(), [&] {
+    doNotOptimize(labelComponents(mask).labels);
+  });
+  runner.run("labeling/4_connected_stats", pixels, 5 * mask.size(), [&] {
+    doNotOptimize(labelComponents(mask, Connectivity::FOUR, true).labels);
+  });
+}
+
+void benchDistanceTransform(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  // Dense and sparse edge maps cost the same
+  for (unsigned threshold : { 128u, 250u }) {
+    const Mat<uint8_t> mask = gray > threshold;
+    runner.run("distance/edges_above_" + std::to_string(threshold), pixels,
+               5 * mask.size(),
+               [&] { doNotOptimize(distanceTransform(mask)); });
+  }
+}
+
+void benchHough(Runner& runner, Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  const auto edges = canny(gray, 50, 180);
+  const auto gradients = sobelXYGradients(gray);
+  runner.run("hough/full", pixels, edges.size(),
+             [&] { doNotOptimize(houghLines(edges)); });
+  runner.run("hough/gradient_band", pixels,
+             edges.size() + 2 * sizeof(double) * pixels,
+             [&] { doNotOptimize(houghLines(edges, gradients)); });
+}
+
+void benchTemplateMatch(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  Mat<uint8_t> templ({ 31, 31, 1 });
+  for (unsigned y = 0; y < 31; ++y) {
+    for (unsigned x = 0; x < 31; ++x) {
+      templ[y][x][0] = uint8_t(gray[100 + y][200 + x][0]);
+    }
+  }
+  runner.run("template_match/31x31", pixels, gray.size(), [&] {
+    doNotOptimize(bestMatches(matchTemplate(gray, templ), 8, 16));
+  });
+}
+
+void benchEqualize(Runner& runner, const Mat<uint8_t>& gray) {
+  const auto pixels = img::height(gray) * img::width(gray);
+  runner.run("equalize/global", pixels, 2 * pixels,
+             [&] { doNotOptimize(equalizeHistogram(gray)); });
+  runner.run("equalize/clahe_8x8", pixels, 2 * pixels,
+             [&] { doNotOptimize(clahe(gray)); });
+}
+
+void benchPng(Runner& runner, const Mat<uint8_t>& rgb) {
+  const auto pixels = img::height(rgb) * img::width(rgb);
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "cpp-image-processing-bench.png")
+                        .string();
+
+  // The read benchmarks need the file even when png/write is filtered out
+  img::write(rgb, path, PNG_COLOR_TYPE_RGB);
+  runner.run("png/write", pixels, rgb.size(),
+             [&] { img::write(rgb, path, PNG_COLOR_TYPE_RGB); });
+  runner.run("png/read", pixels, rgb.size(),
+             [&] { doNotOptimize(img::read(path)); });
+
+  img::ReadOptions grayOptions;
+  grayOptions.grayscale = true;
+  runner.run("png/read_grayscale", pixels, pixels,
+             [&] { doNotOptimize(img::read(path, grayOptions)); });
+
+  runner.run("png/preview_8", pixels, rgb.size(),
+             [&] { doNotOptimize(img::readPreview(path, 8)); });
+  const auto adam7 = (std::filesystem::temp_directory_path() /
+                      "cpp-image-processing-bench-adam7.png")
+                         .string();
+  img::writePng(rgb, adam7, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_ADAM7);
+  runner.run("png/preview_8_adam7", pixels, rgb.size(),
+             [&] { doNotOptimize(img::readPreview(adam7, 8)); });
+  std::remove(adam7.c_str());
+
+  runner.run("png/probe", pixels, 0,
+             [&] { doNotOptimize(img::probe(path).bytes); });
+
+  const auto encoded = img::encode(rgb);
+  runner.run("png/encode", pixels, rgb.size(),
+             [&] { doNotOptimize(img::encode(rgb)); });
+  runner.run("png/decode", pixels, rgb.size(),
+             [&] { doNotOptimize(img::decode(encoded)); });
+  std::remove(path.c_str());
+}
+
+void benchPnm(Runner& runner, const Mat<uint8_t>& rgb) {
+  const auto pixels = img::height(rgb) * img::width(rgb);
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "cpp-image-processing-bench.ppm")
+                        .string();
+
+  img::write(rgb, path);
+  runner.run("pnm/write", pixels, rgb.size(), [&] { img::write(rgb, path); });
+  runner.run("pnm/read", pixels, rgb.size(),
+             [&] { doNotOptimize(img::read(path)); });
+  std::remove(path.c_str());
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--json") {
+      options.json = true;
+    } else if (arg == "--width" && hasValue) {
+      options.width = std::stoul(argv[++i]);
+    } else if (arg == "--height" && hasValue) {
+      options.height = std::stoul(argv[++i]);
+    } else if (arg == "--reps" && hasValue) {
+      options.repetitions = std::max(1ul, std::stoul(argv[++i]));
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = std::stoul(argv[++i]);
+    } else if (arg == "--filter" && hasValue) {
+      options.filter = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return options.width > 8 && options.height > 8;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseArgs(argc, argv, options)) {
+    std::cout << "Usage: " << argv[0]
+              << " [--width N] [--height N] [--reps N] [--seed N]"
+                 " [--filter SUBSTRING] [--json]\n";
+    return 1;
+  }
+
+  const auto rgb = makeImage(options, 3);
+  auto gray = makeImage(options, 1);
+
+  Runner runner(options);
+  if (!options.json) {
+    runner.printHeader();
+  }
+  benchMat(runner, rgb);
+  benchConvolute(runner, gray);
+  benchFilters(runner, rgb, gray);
+  benchResize(runner, rgb);
+  benchMedian(runner, rgb, gray);
+  benchMorphology(runner, gray);
+  benchLabeling(runner, gray);
+  benchDistanceTransform(runner, gray);
+  benchHough(runner, gray);
+  benchTemplateMatch(runner, gray);
+  benchEqualize(runner, gray);
+  benchPng(runner, rgb);
+  benchPnm(runner, rgb);
+
+  const auto poolStats = MatPool::global().stats();
+  if (options.json) {
+    runner.printJson(poolStats);
+  } else {
+    std::cout << "\nMat pool: " << poolStats.hits << " hits, "
+              << poolStats.misses << " misses, high-water mark "
+              << poolStats.highWaterMark / 1024 << " KiB\n";
+  }
+  return 0;
+}
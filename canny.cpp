@@ -1,26 +1,59 @@
 #include "canny.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
 #include "img.hpp"
+#include "parallel.hpp"
 #include "sobel.hpp"
 #include "utility.hpp"
 
-std::pair<Mat<double>, Mat<double>> findGradients(const Mat<uint8_t>& input) {
+/**
+ * Gradient magnitudes and directions. If `histogram` is given, each row
+ * chunk also counts its magnitudes as thinEdges() rounds them, and the
+ * counts are merged at the end.
+ */
+std::pair<Mat<double>, Mat<double>> findGradients(
+    const Mat<uint8_t>& input,
+    MagnitudeHistogram* histogram = nullptr) {
   const auto [bufferX, bufferY] = sobelXYGradients(input);
 
   const auto height = img::height(input);
   const auto width = img::width(input);
 
-  Mat<double> intensities = { { height, width } };
-  Mat<double> directions = { { height, width } };
+  auto intensities = Mat<double>::uninitialized({ height, width });
+  auto directions = Mat<double>::uninitialized({ height, width });
 
-  for (unsigned y = 0; y < height; ++y) {
-    for (unsigned x = 0; x < width; ++x) {
-      const auto xValue = bufferX[y][x][0];
-      const auto yValue = bufferY[y][x][0];
-      intensities[y][x] = std::hypot(xValue, yValue);
-      directions[y][x] = std::atan2(yValue, xValue);
+  std::vector<MagnitudeHistogram> counts(histogram ? maxChunks() : 0);
+  const unsigned chunks = parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / std::max<size_t>(1, width)),
+      [&](size_t begin, size_t end, unsigned chunk) {
+        MagnitudeHistogram* local = histogram ? &counts[chunk] : nullptr;
+        if (local) {
+          local->fill(0);
+        }
+        for (size_t i = begin * width; i < end * width; ++i) {
+          const double xValue = bufferX.data()[i];
+          const double yValue = bufferY.data()[i];
+          const double intensity = std::hypot(xValue, yValue);
+          intensities.data()[i] = intensity;
+          directions.data()[i] = std::atan2(yValue, xValue);
+          if (local) {
+            ++(*local)[unsigned(std::min(std::round(intensity), 255.0))];
+          }
+        }
+      });
+  if (histogram) {
+    histogram->fill(0);
+    for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+      for (unsigned level = 0; level < 256; ++level) {
+        (*histogram)[level] += counts[chunk][level];
+      }
     }
   }
-  return { intensities, directions };
+  return { std::move(intensities), std::move(directions) };
 }
 
 std::array<uint8_t, 4> directionalColor(double intensity, double direction) {
@@ -53,8 +86,8 @@ std::array<uint8_t, 4> directionalColor(double intensity, double direction) {
 
 Mat<uint8_t> directionMap(const Mat<uint8_t>& input) {
   auto [intensities, directions] = findGradients(input);
-  Mat<uint8_t> output = { { directions.dimension(0), directions.dimension(1),
-                            4 } };
+  auto output = Mat<uint8_t>::uninitialized(
+      { directions.dimension(0), directions.dimension(1), 4 });
 
   const auto height = img::height(output);
   const auto width = img::width(output);
@@ -150,9 +183,10 @@ void removeBoundaryArtifacts(Mat<uint8_t>& input) {
   }
 }
 
-Mat<uint8_t> canny(Mat<uint8_t>& input, uint8_t min, uint8_t max) {
-  auto [intensities, directions] = findGradients(input);
-
+Mat<uint8_t> hysteresis(Mat<double>& intensities,
+                        Mat<double>& directions,
+                        uint8_t min,
+                        uint8_t max) {
   auto output = thinEdges(intensities, directions);
   findStrongAndWeakPixels(output, min, max);
   removeIsolatedWeakPixels(output);
@@ -160,3 +194,76 @@ Mat<uint8_t> canny(Mat<uint8_t>& input, uint8_t min, uint8_t max) {
 
   return output;
 }
+
+Mat<uint8_t> canny(Mat<uint8_t>& input, uint8_t min, uint8_t max) {
+  auto [intensities, directions] = findGradients(input);
+  return hysteresis(intensities, directions, min, max);
+}
+
+// Otsu's threshold: the level maximizing the between-class variance of
+// the pixels below it and those at or above it.
+uint8_t otsuThreshold(const MagnitudeHistogram& histogram, size_t total) {
+  double weightedTotal = 0;
+  for (unsigned level = 0; level < 256; ++level) {
+    weightedTotal += double(level) * histogram[level];
+  }
+  double below = 0, weightedBelow = 0, bestVariance = -1;
+  unsigned best = 0;
+  for (unsigned level = 1; level < 256; ++level) {
+    below += histogram[level - 1];
+    weightedBelow += double(level - 1) * histogram[level - 1];
+    const double above = total - below;
+    if (below == 0 || above == 0) {
+      continue;
+    }
+    const double meanBelow = weightedBelow / below;
+    const double meanAbove = (weightedTotal - weightedBelow) / above;
+    const double variance =
+        below * above * (meanAbove - meanBelow) * (meanAbove - meanBelow);
+    if (variance > bestVariance) {
+      bestVariance = variance;
+      best = level;
+    }
+  }
+  return uint8_t(best);
+}
+
+std::pair<uint8_t, uint8_t> cannyThresholds(
+    const MagnitudeHistogram& histogram,
+    const CannyAutoOptions& options) {
+  if (options.lowRatio < 0 || options.lowRatio > 1 ||
+      options.highQuantile < 0 || options.highQuantile > 1) {
+    throw std::invalid_argument(
+        "cannyThresholds: lowRatio and highQuantile must be in [0, 1]");
+  }
+  size_t total = 0;
+  for (const size_t count : histogram) {
+    total += count;
+  }
+  unsigned high = 0;
+  if (options.method == CannyAutoOptions::Method::OTSU) {
+    high = otsuThreshold(histogram, total);
+  } else {
+    // The lowest level with more than highQuantile of the pixels below it
+    const double target = options.highQuantile * total;
+    size_t below = 0;
+    while (high < 255 && below <= target) {
+      below += histogram[high++];
+    }
+  }
+  high = std::max(high, 1u);
+  const auto low = unsigned(std::lround(options.lowRatio * high));
+  return { uint8_t(low), uint8_t(high) };
+}
+
+Mat<uint8_t> canny(Mat<uint8_t>& input,
+                   const CannyAutoOptions& options,
+                   std::pair<uint8_t, uint8_t>* thresholds) {
+  MagnitudeHistogram histogram;
+  auto [intensities, directions] = findGradients(input, &histogram);
+  const auto [low, high] = cannyThresholds(histogram, options);
+  if (thresholds) {
+    *thresholds = { low, high };
+  }
+  return hysteresis(intensities, directions, low, high);
+}
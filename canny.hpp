@@ -1,5 +1,47 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
 #include "mat.hpp"
 
 Mat<uint8_t> canny(Mat<uint8_t>& input, uint8_t min, uint8_t max);
 Mat<uint8_t> directionMap(const Mat<uint8_t>& input);
+
+// Pixel counts of the gradient magnitudes canny() compares against its
+// thresholds: rounded and capped at 255.
+using MagnitudeHistogram = std::array<size_t, 256>;
+
+struct CannyAutoOptions {
+  enum class Method {
+    // The lowest high threshold with more than highQuantile of the pixels
+    // below it
+    PERCENTILE,
+    // The high threshold is Otsu's split of the magnitude histogram
+    OTSU,
+  };
+  Method method = Method::PERCENTILE;
+  double highQuantile = 0.7;
+  // The low threshold as a fraction of the high one
+  double lowRatio = 0.4;
+};
+
+/**
+ * Low and high canny() thresholds picked from a magnitude histogram. The
+ * high threshold is at least 1.
+ */
+std::pair<uint8_t, uint8_t> cannyThresholds(
+    const MagnitudeHistogram& histogram,
+    const CannyAutoOptions& options = {});
+
+/**
+ * canny() with thresholds picked from the image itself. The gradient pass
+ * counts the magnitude histogram as it goes, so this costs no extra sweep
+ * over the image.
+ *
+ * @param thresholds If given, receives the low and high thresholds used
+ */
+Mat<uint8_t> canny(Mat<uint8_t>& input,
+                   const CannyAutoOptions& options = {},
+                   std::pair<uint8_t, uint8_t>* thresholds = nullptr);
@@ -0,0 +1,260 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Arithmetic used when converting From to To: float when neither side is a
+ * double (so SIMD lanes stay 32-bit wide), double otherwise.
+ */
+template <typename From, typename To>
+using convert_compute_t =
+    std::conditional_t<std::is_same_v<From, double> ||
+                           std::is_same_v<To, double>,
+                       double,
+                       float>;
+
+/**
+ * Converts a value to T, rounding to nearest and clamping to T's range when T
+ * is an integral type. NaN becomes 0.
+ */
+template <typename T, typename V>
+T saturateCast(V value) {
+  if constexpr (std::is_integral_v<T> && std::is_floating_point_v<V>) {
+    if (std::isnan(value)) {
+      return 0;
+    }
+    if (value <= std::numeric_limits<T>::min()) {
+      return std::numeric_limits<T>::min();
+    }
+    if (value >= std::numeric_limits<T>::max()) {
+      return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(std::lrint(value));
+  } else if constexpr (std::is_integral_v<T> && std::is_integral_v<V>) {
+    using wide_t = std::common_type_t<T, V, long long>;
+    if (wide_t(value) < wide_t(std::numeric_limits<T>::min())) {
+      return std::numeric_limits<T>::min();
+    }
+    if (wide_t(value) > wide_t(std::numeric_limits<T>::max())) {
+      return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(value);
+  } else {
+    return static_cast<T>(value);
+  }
+}
+
+/**
+ * Vectorized front of convertElements for the common pixel type pairs. Each
+ * specialization converts a multiple of its vector width and returns how many
+ * elements it handled; the scalar loop finishes the rest. Results always
+ * saturate, which is free with SSE pack instructions.
+ */
+template <typename From, typename To>
+struct SimdConvert {
+  template <typename C>
+  static size_t run(const From*, To*, size_t, C, C) {
+    return 0;
+  }
+};
+
+#ifdef __SSE2__
+template <>
+struct SimdConvert<uint8_t, float> {
+  static size_t run(const uint8_t* src,
+                    float* dst,
+                    size_t n,
+                    float scale,
+                    float offset) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 o = _mm_set1_ps(offset);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+      const __m128i lo = _mm_unpacklo_epi8(v, zero);
+      const __m128i hi = _mm_unpackhi_epi8(v, zero);
+      const __m128i parts[4] = {
+          _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+          _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+      for (int k = 0; k < 4; ++k) {
+        const __m128 f = _mm_cvtepi32_ps(parts[k]);
+        _mm_storeu_ps(dst + i + 4 * k, _mm_add_ps(_mm_mul_ps(f, s), o));
+      }
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdConvert<uint8_t, double> {
+  static size_t run(const uint8_t* src,
+                    double* dst,
+                    size_t n,
+                    double scale,
+                    double offset) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d o = _mm_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i v = _mm_loadl_epi64((const __m128i*)(src + i));
+      const __m128i v16 = _mm_unpacklo_epi8(v, zero);
+      const __m128i parts[2] = {_mm_unpacklo_epi16(v16, zero),
+                                _mm_unpackhi_epi16(v16, zero)};
+      for (int k = 0; k < 2; ++k) {
+        const __m128d a = _mm_cvtepi32_pd(parts[k]);
+        const __m128d b = _mm_cvtepi32_pd(_mm_srli_si128(parts[k], 8));
+        _mm_storeu_pd(dst + i + 4 * k, _mm_add_pd(_mm_mul_pd(a, s), o));
+        _mm_storeu_pd(dst + i + 4 * k + 2, _mm_add_pd(_mm_mul_pd(b, s), o));
+      }
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdConvert<float, uint8_t> {
+  static size_t run(const float* src,
+                    uint8_t* dst,
+                    size_t n,
+                    float scale,
+                    float offset) {
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 o = _mm_set1_ps(offset);
+    const __m128 lower = _mm_setzero_ps();
+    const __m128 upper = _mm_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128i words[4];
+      for (int k = 0; k < 4; ++k) {
+        __m128 f = _mm_loadu_ps(src + i + 4 * k);
+        f = _mm_add_ps(_mm_mul_ps(f, s), o);
+        // max() before min() so that NaN ends up as 0
+        f = _mm_min_ps(_mm_max_ps(f, lower), upper);
+        words[k] = _mm_cvtps_epi32(f);
+      }
+      const __m128i lo = _mm_packs_epi32(words[0], words[1]);
+      const __m128i hi = _mm_packs_epi32(words[2], words[3]);
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdConvert<double, uint8_t> {
+  static size_t run(const double* src,
+                    uint8_t* dst,
+                    size_t n,
+                    double scale,
+                    double offset) {
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d o = _mm_set1_pd(offset);
+    const __m128d lower = _mm_setzero_pd();
+    const __m128d upper = _mm_set1_pd(255.0);
+    const auto convert = [&](const double* p) {
+      __m128d d = _mm_loadu_pd(p);
+      d = _mm_add_pd(_mm_mul_pd(d, s), o);
+      d = _mm_min_pd(_mm_max_pd(d, lower), upper);
+      return _mm_cvtpd_epi32(d);
+    };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128i a =
+          _mm_unpacklo_epi64(convert(src + i), convert(src + i + 2));
+      const __m128i b =
+          _mm_unpacklo_epi64(convert(src + i + 4), convert(src + i + 6));
+      const __m128i words = _mm_packs_epi32(a, b);
+      _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(words, words));
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdConvert<float, double> {
+  static size_t run(const float* src,
+                    double* dst,
+                    size_t n,
+                    double scale,
+                    double offset) {
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d o = _mm_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128 f = _mm_loadu_ps(src + i);
+      const __m128d a = _mm_cvtps_pd(f);
+      const __m128d b = _mm_cvtps_pd(_mm_movehl_ps(f, f));
+      _mm_storeu_pd(dst + i, _mm_add_pd(_mm_mul_pd(a, s), o));
+      _mm_storeu_pd(dst + i + 2, _mm_add_pd(_mm_mul_pd(b, s), o));
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdConvert<double, float> {
+  static size_t run(const double* src,
+                    float* dst,
+                    size_t n,
+                    double scale,
+                    double offset) {
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d o = _mm_set1_pd(offset);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128d a = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(src + i), s), o);
+      const __m128d b =
+          _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(src + i + 2), s), o);
+      _mm_storeu_ps(dst + i, _mm_movelh_ps(_mm_cvtpd_ps(a), _mm_cvtpd_ps(b)));
+    }
+    return i;
+  }
+};
+#endif
+
+/**
+ * Writes `saturate ? saturateCast<To>(x * scale + offset)
+ *                  : To(x * scale + offset)` for every element of src to dst.
+ *
+ * Without saturation the conversion is a plain cast, which truncates towards
+ * zero when narrowing to an integral type.
+ */
+template <typename From, typename To>
+void convertElements(const From* src,
+                     To* dst,
+                     size_t n,
+                     double scale = 1,
+                     double offset = 0,
+                     bool saturate = true) {
+  using compute_t = convert_compute_t<From, To>;
+  const auto s = static_cast<compute_t>(scale);
+  const auto o = static_cast<compute_t>(offset);
+
+  // Pack instructions saturate, so the vector path can only stand in for a
+  // plain cast when the conversion cannot overflow or round.
+  constexpr bool widening =
+      std::is_integral_v<From> || std::is_floating_point_v<To>;
+  size_t i = 0;
+  if (saturate || widening) {
+    i = SimdConvert<From, To>::run(src, dst, n, s, o);
+  }
+
+  if (saturate) {
+    for (; i < n; ++i) {
+      dst[i] = saturateCast<To>(static_cast<compute_t>(src[i]) * s + o);
+    }
+  } else {
+    for (; i < n; ++i) {
+      dst[i] = static_cast<To>(static_cast<compute_t>(src[i]) * s + o);
+    }
+  }
+}
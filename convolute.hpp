@@ -1,5 +1,6 @@
 #pragma once
 #include <limits>
+#include "fft_convolution.hpp"
 #include "img.hpp"
 #include "mat.hpp"
 
@@ -13,7 +14,8 @@ T clamp(T val, T min, T max) {
 
 
 /**
- * Convolutes a given image with a kernal, returning an Image of the same type.
+ * Convolutes a given image with a kernal directly, taking every kernal tap
+ * for every pixel.
  *
  * In case of out-of-bound pixel access (which will happen with any kernal
  * bigger than 1x1), The mirrored pixels are used.
@@ -26,7 +28,7 @@ T clamp(T val, T min, T max) {
  * @returns The convolved image
  */
 template <typename V, typename O = V>
-Mat<O> convolute(const Mat<V>& input, const Mat<double>& kernal) {
+Mat<O> directConvolute(const Mat<V>& input, const Mat<double>& kernal) {
   const auto WIDTH = img::width(input);
   const auto HEIGHT = img::height(input);
   const auto CHANNELS = img::channel(input);
@@ -35,12 +37,7 @@ Mat<O> convolute(const Mat<V>& input, const Mat<double>& kernal) {
   const auto COLS = kernal.dimension(1);
   const auto HALF_ROWS = ROWS / 2;
   const auto HALF_COLS = COLS / 2;
-  Mat<O> output = { { HEIGHT, WIDTH, CHANNELS } };
-
-  // If index is over the bound, take the mirrored coordinate
-  const auto mirrorIfNeeded = [](int index, int end) -> int {
-    return index > (end - 1) ? 2 * (end - 1) - index : std::abs(index);
-  };
+  auto output = Mat<O>::uninitialized({ HEIGHT, WIDTH, CHANNELS });
 
   for (unsigned y = 0; y < HEIGHT; ++y) {
     for (unsigned x = 0; x < WIDTH; ++x) {
@@ -52,7 +49,7 @@ Mat<O> convolute(const Mat<V>& input, const Mat<double>& kernal) {
           for (int j = (int)x - (int)HALF_COLS, kernalX = 0;
                j <= int(x + HALF_COLS); ++j, ++kernalX) {
             const double channelVal =
-                input[mirrorIfNeeded(i, HEIGHT)][mirrorIfNeeded(j, WIDTH)][c];
+                input[mirror(i, HEIGHT)][mirror(j, WIDTH)][c];
             const double kernalVal = kernal[kernalY][kernalX];
             sum += channelVal * kernalVal;
           }
@@ -67,4 +64,16 @@ Mat<O> convolute(const Mat<V>& input, const Mat<double>& kernal) {
   return output;
 }
 
-
+/**
+ * Convolutes a given image with a kernal, returning an Image of the same type.
+ *
+ * Kernals of fft::MIN_TAPS or more go through fftConvolute(), smaller ones
+ * are applied directly.
+ */
+template <typename V, typename O = V>
+Mat<O> convolute(const Mat<V>& input, const Mat<double>& kernal) {
+  if (kernal.size() >= fft::MIN_TAPS) {
+    return fftConvolute<V, O>(input, kernal);
+  }
+  return directConvolute<V, O>(input, kernal);
+}
@@ -0,0 +1,148 @@
+#include "distance_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Column distance with no edge in the column. Finite, as the out and bench
+// builds use -Ofast and may assume there are no infinities; increments
+// vanish in its rounding.
+constexpr float NO_EDGE = 1e30f;
+// Columns per block of the column pass: a row segment of each block is
+// scanned at a time, which vectorizes and keeps the block in cache.
+constexpr size_t BLOCK = 256;
+
+/**
+ * Distance to the nearest non-zero pixel in the same column, for the
+ * columns [first, last). Counts stay exact integers in float.
+ */
+void columnPass(const Mat<uint8_t>& mask,
+                float* distances,
+                size_t first,
+                size_t last) {
+  const unsigned height = img::height(mask);
+  const unsigned width = img::width(mask);
+  const size_t pitch = mask.stride(0);
+  const size_t length = last - first;
+
+  float* row = distances + first;
+  const uint8_t* in = mask.data() + first;
+  for (size_t x = 0; x < length; ++x) {
+    row[x] = in[x] ? 0.f : NO_EDGE;
+  }
+  for (unsigned y = 1; y < height; ++y) {
+    const float* above = row;
+    row += width;
+    in += pitch;
+    for (size_t x = 0; x < length; ++x) {
+      row[x] = in[x] ? 0.f : above[x] + 1.f;
+    }
+  }
+  for (unsigned y = height - 1; y-- > 0;) {
+    const float* below = row;
+    row -= width;
+    for (size_t x = 0; x < length; ++x) {
+      row[x] = std::min(row[x], below[x] + 1.f);
+    }
+  }
+}
+
+/**
+ * Replaces one row of column distances by the exact 2D distances. v holds
+ * the centers of the parabolas on the lower envelope and z the points where
+ * each takes over from the previous one; h is the column distance squared
+ * plus q^2. All three are scratch of at least width elements.
+ */
+void rowPass(float* row, unsigned width, int* v, double* z, double* h) {
+  for (unsigned q = 0; q < width; ++q) {
+    h[q] = double(row[q]) * row[q] + double(q) * q;
+  }
+  // Columns without an edge give no parabola
+  int k = -1;
+  for (int q = 0; q < int(width); ++q) {
+    if (row[q] >= NO_EDGE) {
+      continue;
+    }
+    // Parabola q is lower than the envelope's top right of s; drop the top
+    // while s is left of where the top took over. The first parabola
+    // always stays.
+    double s = 0;
+    while (k >= 0) {
+      s = (h[q] - h[v[k]]) / (2.0 * (q - v[k]));
+      if (k == 0 || s > z[k]) {
+        break;
+      }
+      --k;
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+  }
+  if (k < 0) {
+    // Every column is empty, so is the whole mask
+    std::fill(row, row + width, NO_EDGE_DISTANCE);
+    return;
+  }
+  // Each parabola serves the integer x up to where the next one takes
+  // over. Filling those runs directly keeps the per-pixel loop free of
+  // unpredictable branches.
+  int q = 0;
+  for (int segment = 0; segment <= k; ++segment) {
+    const int end =
+        segment == k
+            ? int(width)
+            : std::clamp(int(std::floor(z[segment + 1])) + 1, q, int(width));
+    const double center = v[segment];
+    const double base = h[v[segment]];
+    for (; q < end; ++q) {
+      // (q - v)^2 + column(v)^2
+      row[q] = float(base - 2.0 * q * center + double(q) * q);
+    }
+  }
+  // Square roots in a separate loop, which vectorizes
+  for (unsigned x = 0; x < width; ++x) {
+    row[x] = std::sqrt(row[x]);
+  }
+}
+
+}  // namespace
+
+Mat<float> distanceTransform(const Mat<uint8_t>& mask) {
+  if (img::channel(mask) != 1) {
+    throw std::invalid_argument("distanceTransform: mask needs 1 channel");
+  }
+  if (mask.stride(1) != 1) {
+    return distanceTransform(Mat<uint8_t>(mask));
+  }
+  const unsigned height = img::height(mask);
+  const unsigned width = img::width(mask);
+  auto output = Mat<float>::uninitialized({ height, width, 1 });
+  if (output.size() == 0) {
+    return output;
+  }
+
+  const size_t blocks = (width + BLOCK - 1) / BLOCK;
+  parallelFor(blocks, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t block = begin; block < end; ++block) {
+      columnPass(mask, output.data(), block * BLOCK,
+                 std::min<size_t>(width, (block + 1) * BLOCK));
+    }
+  });
+
+  parallelFor(height, std::max<size_t>(1, (1 << 14) / width),
+              [&](size_t begin, size_t end, unsigned) {
+                std::vector<int> v(width);
+                std::vector<double> z(width), h(width);
+                for (size_t y = begin; y < end; ++y) {
+                  rowPass(output.data() + y * width, width, v.data(),
+                          z.data(), h.data());
+                }
+              });
+  return output;
+}
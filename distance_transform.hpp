@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+#include "mat.hpp"
+
+// Distance of every pixel of a mask without non-zero pixels. Finite, so
+// that comparisons against it survive -Ofast, which assumes there are no
+// infinities.
+constexpr float NO_EDGE_DISTANCE = std::numeric_limits<float>::max();
+
+/**
+ * Exact Euclidean distance from every pixel to the nearest non-zero pixel
+ * of a single channel mask, such as canny() output. Non-zero pixels get 0;
+ * if the mask has none, every pixel gets NO_EDGE_DISTANCE.
+ *
+ * Separable, after Felzenszwalb and Huttenlocher: a column pass finds the
+ * distance to the nearest edge pixel in each column by scanning down and up
+ * whole rows at a time, then each row takes the lower envelope of the
+ * parabolas (x - q)^2 + column(q)^2. Both passes are linear in the pixel
+ * count whatever the edge density, and both run across threads.
+ *
+ * @throws std::invalid_argument for masks with more than one channel
+ */
+Mat<float> distanceTransform(const Mat<uint8_t>& mask);
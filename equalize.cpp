@@ -0,0 +1,261 @@
+#include "equalize.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Pixels per parallelFor chunk of rows
+constexpr size_t GRAIN = 1 << 16;
+constexpr unsigned LEVELS = 256;
+
+/**
+ * Histogram counted into four interleaved tables, so that runs of equal
+ * pixels, which are common in flat regions, increment different counters
+ * instead of each waiting on the previous store to the same one.
+ */
+class HistogramCounter {
+ public:
+  void add(const uint8_t* values, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+      ++mCounts[0][values[i]];
+      ++mCounts[1][values[i + 1]];
+      ++mCounts[2][values[i + 2]];
+      ++mCounts[3][values[i + 3]];
+    }
+    for (; i < count; ++i) {
+      ++mCounts[0][values[i]];
+    }
+  }
+
+  template <typename T>
+  void addTo(std::array<T, LEVELS>& histogram) const {
+    for (unsigned level = 0; level < LEVELS; ++level) {
+      histogram[level] += T(mCounts[0][level]) + mCounts[1][level] +
+                          mCounts[2][level] + mCounts[3][level];
+    }
+  }
+
+ private:
+  uint32_t mCounts[4][LEVELS] = {};
+};
+
+void checkGrayscale(const Mat<uint8_t>& image, const char* name) {
+  if (img::channel(image) != 1) {
+    throw std::invalid_argument(std::string(name) + ": image needs 1 channel");
+  }
+}
+
+size_t rowGrain(unsigned width) {
+  return std::max<size_t>(1, GRAIN / std::max(1u, width));
+}
+
+Mat<uint8_t> applyLut(const Mat<uint8_t>& image,
+                      const std::array<uint8_t, LEVELS>& lut) {
+  const unsigned height = img::height(image), width = img::width(image);
+  const size_t pitch = image.stride(0);
+  auto output = Mat<uint8_t>::uninitialized({ height, width, 1 });
+  parallelFor(height, rowGrain(width), [&](size_t begin, size_t end, unsigned) {
+    for (size_t y = begin; y < end; ++y) {
+      const uint8_t* in = image.data() + y * pitch;
+      uint8_t* out = output.data() + y * width;
+      for (unsigned x = 0; x < width; ++x) {
+        out[x] = lut[in[x]];
+      }
+    }
+  });
+  return output;
+}
+
+// Clips every bin at `limit` and hands the excess back evenly, the
+// remainder one count each to bins spread across the range.
+void clipHistogram(std::array<uint32_t, LEVELS>& histogram, uint32_t limit) {
+  uint32_t excess = 0;
+  for (auto& count : histogram) {
+    if (count > limit) {
+      excess += count - limit;
+      count = limit;
+    }
+  }
+  const uint32_t share = excess / LEVELS;
+  uint32_t remainder = excess % LEVELS;
+  for (auto& count : histogram) {
+    count += share;
+  }
+  if (remainder > 0) {
+    const unsigned step = std::max(1u, LEVELS / remainder);
+    for (unsigned level = 0; level < LEVELS && remainder > 0;
+         level += step, --remainder) {
+      ++histogram[level];
+    }
+  }
+}
+
+size_t tileStart(unsigned tile, unsigned size, unsigned tiles) {
+  return size_t(tile) * size / tiles;
+}
+
+// Equalization table of the pixels [top, bottom) x [left, right).
+void tileLut(const Mat<uint8_t>& image,
+             size_t top,
+             size_t bottom,
+             size_t left,
+             size_t right,
+             double clipLimit,
+             uint8_t* lut) {
+  HistogramCounter counter;
+  for (size_t y = top; y < bottom; ++y) {
+    counter.add(image.data() + y * image.stride(0) + left, right - left);
+  }
+  std::array<uint32_t, LEVELS> histogram{};
+  counter.addTo(histogram);
+
+  const uint32_t area = uint32_t((bottom - top) * (right - left));
+  if (clipLimit > 0) {
+    clipHistogram(histogram,
+                  std::max(1u, uint32_t(clipLimit * area / LEVELS)));
+  }
+  uint64_t cumulative = 0;
+  for (unsigned level = 0; level < LEVELS; ++level) {
+    cumulative += histogram[level];
+    lut[level] = uint8_t((cumulative * 255 + area / 2) / area);
+  }
+}
+
+// The two tiles whose centers bracket a row or column, and how far it lies
+// from the first toward the second in 1/256ths. The output pass blends in
+// fixed point, which is about twice as fast as in float.
+struct AxisWeight {
+  unsigned low, high;
+  int weight;
+};
+
+/**
+ * Interpolation weights for every position along an axis of `size` split
+ * into `tiles`. Positions before the first tile center or after the last
+ * one only use that tile.
+ */
+std::vector<AxisWeight> axisWeights(unsigned size, unsigned tiles) {
+  std::vector<float> centers(tiles);
+  for (unsigned tile = 0; tile < tiles; ++tile) {
+    centers[tile] = (tileStart(tile, size, tiles) +
+                     tileStart(tile + 1, size, tiles) - 1) /
+                    2.f;
+  }
+  std::vector<AxisWeight> weights(size);
+  unsigned tile = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    while (tile + 1 < tiles && centers[tile + 1] <= i) {
+      ++tile;
+    }
+    if (tile + 1 == tiles || i <= centers[tile]) {
+      weights[i] = { tile, tile, 0 };
+    } else {
+      weights[i] = { tile, tile + 1,
+                     int((i - centers[tile]) * 256 /
+                             (centers[tile + 1] - centers[tile]) +
+                         0.5f) };
+    }
+  }
+  return weights;
+}
+
+}  // namespace
+
+Mat<uint8_t> equalizeHistogram(const Mat<uint8_t>& image) {
+  checkGrayscale(image, "equalizeHistogram");
+  if (image.stride(1) != 1) {
+    return equalizeHistogram(Mat<uint8_t>(image));
+  }
+  const unsigned height = img::height(image), width = img::width(image);
+  const size_t pitch = image.stride(0);
+
+  std::vector<HistogramCounter> counters(maxChunks());
+  const unsigned chunks = parallelFor(
+      height, rowGrain(width), [&](size_t begin, size_t end, unsigned chunk) {
+        for (size_t y = begin; y < end; ++y) {
+          counters[chunk].add(image.data() + y * pitch, width);
+        }
+      });
+  std::array<size_t, LEVELS> histogram{};
+  for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+    counters[chunk].addTo(histogram);
+  }
+
+  const size_t total = size_t(height) * width;
+  const auto first = std::find_if(histogram.begin(), histogram.end(),
+                                   [](size_t count) { return count > 0; });
+  if (first == histogram.end() || *first == total) {
+    return Mat<uint8_t>(image);
+  }
+  // The darkest level in use maps to 0
+  const size_t darkest = *first, range = total - darkest;
+  std::array<uint8_t, LEVELS> lut{};
+  size_t cumulative = 0;
+  for (unsigned level = 0; level < LEVELS; ++level) {
+    cumulative += histogram[level];
+    if (cumulative >= darkest) {
+      lut[level] = uint8_t(((cumulative - darkest) * 255 + range / 2) / range);
+    }
+  }
+  return applyLut(image, lut);
+}
+
+Mat<uint8_t> clahe(const Mat<uint8_t>& image, const ClaheOptions& options) {
+  checkGrayscale(image, "clahe");
+  const unsigned height = img::height(image), width = img::width(image);
+  const unsigned tilesY = options.tilesY, tilesX = options.tilesX;
+  if (tilesY == 0 || tilesX == 0 || tilesY > height || tilesX > width) {
+    throw std::invalid_argument("clahe: " + std::to_string(tilesY) + "x" +
+                                std::to_string(tilesX) +
+                                " tiles do not fit the image");
+  }
+  if (image.stride(1) != 1) {
+    return clahe(Mat<uint8_t>(image), options);
+  }
+
+  std::vector<uint8_t> luts(size_t(tilesY) * tilesX * LEVELS);
+  parallelFor(size_t(tilesY) * tilesX, 1,
+              [&](size_t begin, size_t end, unsigned) {
+                for (size_t tile = begin; tile < end; ++tile) {
+                  const unsigned ty = tile / tilesX, tx = tile % tilesX;
+                  tileLut(image, tileStart(ty, height, tilesY),
+                          tileStart(ty + 1, height, tilesY),
+                          tileStart(tx, width, tilesX),
+                          tileStart(tx + 1, width, tilesX), options.clipLimit,
+                          luts.data() + tile * LEVELS);
+                }
+              });
+
+  const auto rows = axisWeights(height, tilesY);
+  const auto columns = axisWeights(width, tilesX);
+  const size_t pitch = image.stride(0);
+  const size_t lutRow = size_t(tilesX) * LEVELS;
+  auto output = Mat<uint8_t>::uninitialized({ height, width, 1 });
+  parallelFor(height, rowGrain(width), [&](size_t begin, size_t end, unsigned) {
+    for (size_t y = begin; y < end; ++y) {
+      const uint8_t* upper = luts.data() + rows[y].low * lutRow;
+      const uint8_t* lower = luts.data() + rows[y].high * lutRow;
+      const int wy = rows[y].weight;
+      const uint8_t* in = image.data() + y * pitch;
+      uint8_t* out = output.data() + y * width;
+      for (unsigned x = 0; x < width; ++x) {
+        const unsigned left = columns[x].low * LEVELS + in[x];
+        const unsigned right = columns[x].high * LEVELS + in[x];
+        const int wx = columns[x].weight;
+        const int top = (upper[left] << 8) + wx * (upper[right] - upper[left]);
+        const int bottom =
+            (lower[left] << 8) + wx * (lower[right] - lower[left]);
+        out[x] = uint8_t(((top << 8) + wy * (bottom - top) + (1 << 15)) >> 16);
+      }
+    }
+  });
+  return output;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+#include "mat.hpp"
+
+/**
+ * Global histogram equalization of a grayscale image: the darkest level in
+ * use maps to 0, the brightest to 255 and everything in between follows
+ * the cumulative histogram. An image of a single level is returned as is.
+ *
+ * @throws std::invalid_argument unless the image has 1 channel
+ */
+Mat<uint8_t> equalizeHistogram(const Mat<uint8_t>& image);
+
+struct ClaheOptions {
+  // Grid of tiles, each with its own equalization
+  unsigned tilesY = 8, tilesX = 8;
+  // Histogram bins are clipped at this multiple of a tile's mean bin count
+  // and the excess spread over all bins, which bounds the contrast gain;
+  // 0 or less for no clipping
+  double clipLimit = 2;
+};
+
+/**
+ * Contrast limited adaptive histogram equalization of a grayscale image.
+ *
+ * Tile histograms are counted in parallel, clipped and turned into lookup
+ * tables. The output is then written in one pass, each pixel blending the
+ * lookup tables of the four tiles whose centers surround it bilinearly, so
+ * no seams show along tile borders.
+ *
+ * @throws std::invalid_argument unless the image has 1 channel and at
+ *         least as many rows and columns as tiles
+ */
+Mat<uint8_t> clahe(const Mat<uint8_t>& image, const ClaheOptions& options = {});
@@ -0,0 +1,261 @@
+#include "fft_convolution.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "parallel.hpp"
+
+namespace fft {
+namespace {
+
+// ::mirror() repeated for kernels wider than the image: the reflection has
+// a period of 2 * (end - 1)
+int mirrorRepeated(int index, int end) {
+  if (end == 1) {
+    return 0;
+  }
+  const int period = 2 * (end - 1);
+  index %= period;
+  if (index < 0) {
+    index += period;
+  }
+  return ::mirror(index, end);
+}
+
+size_t nextPowerOfTwo(size_t value) {
+  size_t power = 1;
+  while (power < value) {
+    power <<= 1;
+  }
+  return power;
+}
+
+/**
+ * Radix-2 transforms of an n x n complex tile held as separate real and
+ * imaginary planes. Only columns are ever transformed: every butterfly
+ * combines two whole rows, which vectorizes, and a transpose in between
+ * turns the rows into columns. The spectrum therefore comes out
+ * transposed, which is harmless as long as every spectrum is made the same
+ * way, and the inverse transposes it back.
+ */
+class Transform {
+ public:
+  explicit Transform(size_t n) : mN(n), mCos(n / 2), mSin(n / 2), mReverse(n) {
+    for (size_t k = 0; k < n / 2; ++k) {
+      mCos[k] = std::cos(2 * M_PI * k / n);
+      mSin[k] = std::sin(2 * M_PI * k / n);
+    }
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < n) {
+      ++bits;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      size_t reversed = 0;
+      for (unsigned b = 0; b < bits; ++b) {
+        reversed |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      mReverse[i] = reversed;
+    }
+  }
+
+  size_t size() const { return mN; }
+
+  void forward(double* re, double* im) const {
+    columns(re, im, -1);
+    transpose(re);
+    transpose(im);
+    columns(re, im, -1);
+  }
+
+  void inverse(double* re, double* im) const {
+    columns(re, im, 1);
+    transpose(re);
+    transpose(im);
+    columns(re, im, 1);
+  }
+
+ private:
+  void columns(double* re, double* im, double sign) const {
+    const size_t n = mN;
+    for (size_t i = 0; i < n; ++i) {
+      if (i < mReverse[i]) {
+        std::swap_ranges(re + i * n, re + (i + 1) * n, re + mReverse[i] * n);
+        std::swap_ranges(im + i * n, im + (i + 1) * n, im + mReverse[i] * n);
+      }
+    }
+    for (size_t length = 2; length <= n; length <<= 1) {
+      const size_t half = length / 2;
+      const size_t step = n / length;
+      for (size_t start = 0; start < n; start += length) {
+        for (size_t j = 0; j < half; ++j) {
+          const double wr = mCos[j * step];
+          const double wi = sign * mSin[j * step];
+          double* __restrict ar = re + (start + j) * n;
+          double* __restrict ai = im + (start + j) * n;
+          double* __restrict br = re + (start + j + half) * n;
+          double* __restrict bi = im + (start + j + half) * n;
+          for (size_t c = 0; c < n; ++c) {
+            const double tr = br[c] * wr - bi[c] * wi;
+            const double ti = br[c] * wi + bi[c] * wr;
+            br[c] = ar[c] - tr;
+            bi[c] = ai[c] - ti;
+            ar[c] += tr;
+            ai[c] += ti;
+          }
+        }
+      }
+    }
+  }
+
+  void transpose(double* data) const {
+    constexpr size_t BLOCK = 16;
+    const size_t n = mN;
+    for (size_t by = 0; by < n; by += BLOCK) {
+      for (size_t bx = by; bx < n; bx += BLOCK) {
+        for (size_t y = by; y < std::min(n, by + BLOCK); ++y) {
+          for (size_t x = std::max(bx, y + 1); x < std::min(n, bx + BLOCK);
+               ++x) {
+            std::swap(data[y * n + x], data[x * n + y]);
+          }
+        }
+      }
+    }
+  }
+
+  size_t mN;
+  std::vector<double> mCos, mSin;
+  std::vector<size_t> mReverse;
+};
+
+struct Spectrum {
+  std::vector<double> re, im;
+};
+
+}  // namespace
+
+void correlatePlanes(const double* planes,
+                     unsigned count,
+                     unsigned height,
+                     unsigned width,
+                     const std::vector<const Mat<double>*>& kernels,
+                     const std::vector<double*>& outputs) {
+  if (kernels.size() != outputs.size()) {
+    throw std::invalid_argument("correlatePlanes: one output per kernel");
+  }
+  if (kernels.empty() || count == 0 || height == 0 || width == 0) {
+    return;
+  }
+  // Kernels share one footprint, each embedded with its anchor, index
+  // size / 2 on each axis like in convolute(), on the common anchor.
+  unsigned rows = 0, cols = 0;
+  for (const auto* kernel : kernels) {
+    rows = std::max<unsigned>(rows, kernel->dimension(0));
+    cols = std::max<unsigned>(cols, kernel->dimension(1));
+  }
+  const int anchorY = rows / 2, anchorX = cols / 2;
+
+  // Tiles about four times the kernel keep most of each transform valid,
+  // but there is no point in tiles beyond the padded image.
+  const size_t footprint = std::max(rows, cols);
+  size_t n = std::max<size_t>(32, nextPowerOfTwo(4 * footprint));
+  n = std::min(n, nextPowerOfTwo(std::max(height + rows, width + cols)));
+  n = std::max(n, nextPowerOfTwo(footprint));
+  const Transform transform(n);
+  const size_t tileSize = n * n;
+  // Output rows and columns each tile yields
+  const unsigned stepY = unsigned(n) - rows + 1;
+  const unsigned stepX = unsigned(n) - cols + 1;
+
+  // Flipped so the circular convolution correlates; 1 / n^2 undoes the
+  // unnormalized inverse.
+  std::vector<Spectrum> spectra(kernels.size());
+  parallelFor(kernels.size(), 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t k = begin; k < end; ++k) {
+      const Mat<double>& kernel = *kernels[k];
+      const unsigned kRows = kernel.dimension(0), kCols = kernel.dimension(1);
+      const unsigned top = anchorY - kRows / 2, left = anchorX - kCols / 2;
+      auto& spectrum = spectra[k];
+      spectrum.re.assign(tileSize, 0);
+      spectrum.im.assign(tileSize, 0);
+      for (unsigned i = 0; i < kRows; ++i) {
+        for (unsigned j = 0; j < kCols; ++j) {
+          spectrum.re[(rows - 1 - top - i) * n + (cols - 1 - left - j)] =
+              kernel[i][j] / double(tileSize);
+        }
+      }
+      transform.forward(spectrum.re.data(), spectrum.im.data());
+    }
+  });
+
+  const unsigned tilesY = (height + stepY - 1) / stepY;
+  const unsigned tilesX = (width + stepX - 1) / stepX;
+  const size_t tilesPerPlane = size_t(tilesY) * tilesX;
+  const size_t tiles = tilesPerPlane * count;
+  const size_t planeSize = size_t(height) * width;
+
+  // Two tiles per transform, one as the real and one as the imaginary part
+  parallelFor((tiles + 1) / 2, 1, [&](size_t begin, size_t end, unsigned) {
+    std::vector<double> re(tileSize), im(tileSize);
+    std::vector<double> productRe(tileSize), productIm(tileSize);
+    std::vector<int> rowIndex(n), colIndex(n);
+
+    const auto fill = [&](size_t tile, double* data) {
+      const size_t plane = tile / tilesPerPlane;
+      const unsigned ty = (tile % tilesPerPlane) / tilesX;
+      const unsigned tx = (tile % tilesPerPlane) % tilesX;
+      for (size_t i = 0; i < n; ++i) {
+        rowIndex[i] = mirrorRepeated(int(ty * stepY + i) - anchorY, height);
+        colIndex[i] = mirrorRepeated(int(tx * stepX + i) - anchorX, width);
+      }
+      const double* source = planes + plane * planeSize;
+      for (size_t y = 0; y < n; ++y) {
+        const double* row = source + size_t(rowIndex[y]) * width;
+        for (size_t x = 0; x < n; ++x) {
+          data[y * n + x] = row[colIndex[x]];
+        }
+      }
+    };
+    const auto store = [&](size_t tile, const double* data, double* output) {
+      const size_t plane = tile / tilesPerPlane;
+      const unsigned y0 = (tile % tilesPerPlane) / tilesX * stepY;
+      const unsigned x0 = (tile % tilesPerPlane) % tilesX * stepX;
+      const unsigned validY = std::min(stepY, height - y0);
+      const unsigned validX = std::min(stepX, width - x0);
+      double* target = output + plane * planeSize;
+      for (unsigned y = 0; y < validY; ++y) {
+        std::copy_n(data + (y + rows - 1) * n + cols - 1, validX,
+                    target + size_t(y0 + y) * width + x0);
+      }
+    };
+
+    for (size_t pair = begin; pair < end; ++pair) {
+      const size_t first = 2 * pair;
+      const bool paired = first + 1 < tiles;
+      fill(first, re.data());
+      if (paired) {
+        fill(first + 1, im.data());
+      } else {
+        std::fill(im.begin(), im.end(), 0);
+      }
+      transform.forward(re.data(), im.data());
+
+      for (size_t k = 0; k < kernels.size(); ++k) {
+        const double* __restrict kr = spectra[k].re.data();
+        const double* __restrict ki = spectra[k].im.data();
+        for (size_t i = 0; i < tileSize; ++i) {
+          productRe[i] = re[i] * kr[i] - im[i] * ki[i];
+          productIm[i] = re[i] * ki[i] + im[i] * kr[i];
+        }
+        transform.inverse(productRe.data(), productIm.data());
+        // The kernel is real, so the two tiles come back apart
+        store(first, productRe.data(), outputs[k]);
+        if (paired) {
+          store(first + 1, productIm.data(), outputs[k]);
+        }
+      }
+    }
+  });
+}
+
+}  // namespace fft
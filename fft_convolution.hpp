@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "img.hpp"
+#include "mat.hpp"
+
+namespace fft {
+
+/**
+ * Kernels with at least this many taps go through the FFT path of
+ * convolute(). Speed alone would send every kernel there: on a 640x480
+ * image (convolute/direct vs convolute/fft) the direct loop costs about
+ * 35 ns plus 20 ns per tap and pixel, 84 ns for 1x3 and 200 ns for 3x3,
+ * while FFT convolution stays at 25 to 45 ns per pixel from 1x3 to 31x31.
+ * Direct sums of short integer or dyadic kernels are exact, though, and
+ * FFT round-off (around 1e-13) turns their exact zeros into tiny values of
+ * either sign: routing the 3- to 7-tap Sobel and Gaussian kernels through
+ * FFTs changes the gradient directions and canny() output. Kernels stay
+ * direct below 5x5, which covers all of those.
+ */
+constexpr size_t MIN_TAPS = 25;
+
+/**
+ * Correlates `count` planes of height x width doubles, stored one after the
+ * other, with each kernel, mirroring borders like convolute(). outputs[k]
+ * receives the planes for kernels[k] in the same layout.
+ *
+ * Overlap-save: the image is cut into power-of-two tiles, two of which
+ * share each complex 2D transform as its real and imaginary parts. Each
+ * tile is transformed once, multiplied by the precomputed spectrum of
+ * every kernel and transformed back, keeping the part the circular
+ * convolution did not wrap. Tiles are spread across threads.
+ */
+void correlatePlanes(const double* planes,
+                     unsigned count,
+                     unsigned height,
+                     unsigned width,
+                     const std::vector<const Mat<double>*>& kernels,
+                     const std::vector<double*>& outputs);
+
+}  // namespace fft
+
+/**
+ * Applies every kernel of a filter bank to the image, like calling
+ * convolute() once per kernel, but the image is transformed only once.
+ * Kernels may differ in size.
+ */
+template <typename V, typename O = V>
+std::vector<Mat<O>> convoluteBank(const Mat<V>& input,
+                                  const std::vector<Mat<double>>& kernels) {
+  if (!input.isContiguous()) {
+    return convoluteBank<V, O>(Mat<V>(input), kernels);
+  }
+  const unsigned height = img::height(input);
+  const unsigned width = img::width(input);
+  const unsigned channels = img::channel(input);
+  const size_t planeSize = size_t(height) * width;
+
+  std::vector<double> planes(planeSize * channels);
+  for (size_t i = 0; i < planeSize; ++i) {
+    for (unsigned c = 0; c < channels; ++c) {
+      planes[c * planeSize + i] = input.data()[i * channels + c];
+    }
+  }
+
+  std::vector<const Mat<double>*> bank;
+  std::vector<std::vector<double>> responses(kernels.size());
+  std::vector<double*> outputs;
+  for (size_t k = 0; k < kernels.size(); ++k) {
+    bank.push_back(&kernels[k]);
+    responses[k].resize(planes.size());
+    outputs.push_back(responses[k].data());
+  }
+  fft::correlatePlanes(planes.data(), channels, height, width, bank, outputs);
+
+  std::vector<Mat<O>> results;
+  for (const auto& response : responses) {
+    auto output = Mat<O>::uninitialized({ height, width, channels });
+    for (size_t i = 0; i < planeSize; ++i) {
+      for (unsigned c = 0; c < channels; ++c) {
+        double value = response[c * planeSize + i];
+        if constexpr (std::is_integral_v<O>) {
+          // Round-off must not push an exact integer below it, where the
+          // conversion would truncate it to the next one down.
+          const double nearest = std::round(value);
+          if (std::abs(value - nearest) < 1e-6) {
+            value = nearest;
+          }
+        }
+        if constexpr (std::is_unsigned_v<O>) {
+          value = std::clamp<double>(value, 0, std::numeric_limits<O>::max());
+        }
+        output.data()[i * channels + c] = O(value);
+      }
+    }
+    results.push_back(std::move(output));
+  }
+  return results;
+}
+
+/**
+ * convolute() through FFTs: the cost per pixel grows with the log of the
+ * kernel size instead of its area.
+ */
+template <typename V, typename O = V>
+Mat<O> fftConvolute(const Mat<V>& input, const Mat<double>& kernel) {
+  auto results = convoluteBank<V, O>(input, { kernel });
+  return std::move(results.front());
+}
@@ -18,24 +18,19 @@ Mat<uint8_t> gaussianY(const Mat<uint8_t>& image) {
 }
 
 Mat<uint8_t> gaussianXX(const Mat<uint8_t>& image) {
-  Mat<double> cpy = image.clone<double>();
   Mat<double> kernal({1, 7}, {0.09, 0.41, 0, -1.0, 0, 0.41, 0.09});
-  cpy = convolute(cpy, kernal);
-  normalize<double>(cpy, 0, 255);
-  return cpy.clone<uint8_t>();
+  const auto response = convolute<uint8_t, double>(image, kernal);
+  return normalizeTo<uint8_t>(response, 0, 255, true);
 }
 
 Mat<uint8_t> gaussianYY(const Mat<uint8_t>& image) {
-  Mat<double> cpy = image.clone<double>();
   Mat<double> kernal({7, 1}, {0.09, 0.41, 0, -1.0, 0, 0.41, 0.09});
-  cpy = convolute(cpy, kernal);
-  normalize<double>(cpy, 0, 255);
-  return cpy.clone<uint8_t>();
+  const auto response = convolute<uint8_t, double>(image, kernal);
+  return normalizeTo<uint8_t>(response, 0, 255, true);
 }
 
 Mat<uint8_t> gaussian2nd(const Mat<uint8_t>& image) {
   constexpr unsigned KERNAL_SIZE = 7;
-  Mat<double> cpy = image.clone<double>();
 
   Mat<double> kernal({KERNAL_SIZE, KERNAL_SIZE},
                      [KERNAL_SIZE](unsigned i) -> double {
@@ -47,9 +42,8 @@ Mat<uint8_t> gaussian2nd(const Mat<uint8_t>& image) {
                        return k * (1 - ((x * x + y * y) / (2 * sig * sig))) *
                               std::exp(-((x * x + y * y) / (2 * sig * sig)));
                      });
-  cpy = convolute(cpy, kernal);
-  normalize<double>(cpy, 0, 255);
-  return cpy.clone<uint8_t>();
+  const auto response = convolute<uint8_t, double>(image, kernal);
+  return normalizeTo<uint8_t>(response, 0, 255, true);
 }
 
 Mat<uint8_t> gaussian(const Mat<uint8_t>& image) {
@@ -1,21 +1,214 @@
 #include "grayscale.hpp"
-#include "convolute.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
 #include "img.hpp"
+#include "parallel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GRAYSCALE_HAS_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Q15 fixed-point luma weights. The weighted sets sum to exactly 1 << 15; the
+// average set sums to one more, which still rounds every channel sum exactly
+// like round(sum / 3.0).
+constexpr unsigned SHIFT = 15;
+constexpr int32_t BIAS = 1 << (SHIFT - 1);
+
+struct FixedWeights {
+  int16_t r, g, b;
+};
+
+FixedWeights fixedWeights(GrayscaleWeights weights) {
+  switch (weights) {
+    case GrayscaleWeights::AVERAGE:
+      return { 10923, 10923, 10923 };
+    case GrayscaleWeights::BT601:
+      return { 9798, 19235, 3735 };
+    case GrayscaleWeights::BT709:
+      return { 6966, 23436, 2366 };
+  }
+  return { 10923, 10923, 10923 };
+}
+
+template <unsigned CHANNELS>
+void grayscaleScalar(const uint8_t* src,
+                     uint8_t* dst,
+                     size_t pixels,
+                     FixedWeights w) {
+  for (size_t i = 0; i < pixels; ++i) {
+    const uint8_t* p = src + i * CHANNELS;
+    dst[i] = (p[0] * w.r + p[1] * w.g + p[2] * w.b + BIAS) >> SHIFT;
+  }
+}
+
+#ifdef GRAYSCALE_HAS_AVX2_KERNELS
+// Four whole RGB pixels per 128-bit lane, shuffled into (R, G) and (B, 0)
+// 16-bit pairs for madd. Returns the eight unpacked luma values.
+__attribute__((target("avx2"))) inline __m256i rgbLuma8(const uint8_t* p,
+                                                        __m256i rgWeights,
+                                                        __m256i bWeights) {
+  const __m256i rgMask = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1));
+  const __m256i bMask = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1));
+  const __m256i v = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+      _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+  const __m256i rg =
+      _mm256_madd_epi16(_mm256_shuffle_epi8(v, rgMask), rgWeights);
+  const __m256i b = _mm256_madd_epi16(_mm256_shuffle_epi8(v, bMask), bWeights);
+  const __m256i sum = _mm256_add_epi32(rg, b);
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(BIAS)),
+                           SHIFT);
+}
+
+// Masking and shifting each 32-bit RGBA pixel gives (R, B) and (G, A) 16-bit
+// pairs without any shuffles; alpha gets weight 0.
+__attribute__((target("avx2"))) inline __m256i rgbaLuma8(const uint8_t* p,
+                                                         __m256i rbWeights,
+                                                         __m256i gaWeights) {
+  const __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  const __m256i rb = _mm256_madd_epi16(
+      _mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), rbWeights);
+  const __m256i ga = _mm256_madd_epi16(_mm256_srli_epi16(v, 8), gaWeights);
+  const __m256i sum = _mm256_add_epi32(rb, ga);
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(BIAS)),
+                           SHIFT);
+}
+
+// Packs two groups of eight 32-bit luma values into 16 bytes, in order.
+__attribute__((target("avx2"))) inline void storeLuma16(uint8_t* dst,
+                                                        __m256i lo,
+                                                        __m256i hi) {
+  __m256i words = _mm256_packs_epi32(lo, hi);
+  words = _mm256_permute4x64_epi64(words, _MM_SHUFFLE(3, 1, 2, 0));
+  __m256i bytes = _mm256_packus_epi16(words, words);
+  bytes = _mm256_permute4x64_epi64(bytes, _MM_SHUFFLE(3, 1, 2, 0));
+  _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(bytes));
+}
+
+__attribute__((target("avx2"))) size_t grayscaleRgbAvx2(const uint8_t* src,
+                                                        uint8_t* dst,
+                                                        size_t pixels,
+                                                        FixedWeights w) {
+  const __m256i rgWeights =
+      _mm256_set1_epi32((uint16_t(w.g) << 16) | uint16_t(w.r));
+  const __m256i bWeights = _mm256_set1_epi32(uint16_t(w.b));
+
+  size_t i = 0;
+  // The last 16-byte load of an iteration reaches 4 bytes past its pixels
+  for (; (i + 16) * 3 + 4 <= pixels * 3; i += 16) {
+    const uint8_t* p = src + i * 3;
+    storeLuma16(dst + i, rgbLuma8(p, rgWeights, bWeights),
+                rgbLuma8(p + 24, rgWeights, bWeights));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t grayscaleRgbaAvx2(const uint8_t* src,
+                                                         uint8_t* dst,
+                                                         size_t pixels,
+                                                         FixedWeights w) {
+  const __m256i rbWeights =
+      _mm256_set1_epi32((uint16_t(w.b) << 16) | uint16_t(w.r));
+  const __m256i gaWeights = _mm256_set1_epi32(uint16_t(w.g));
+
+  size_t i = 0;
+  for (; i + 16 <= pixels; i += 16) {
+    const uint8_t* p = src + i * 4;
+    storeLuma16(dst + i, rgbaLuma8(p, rbWeights, gaWeights),
+                rgbaLuma8(p + 32, rbWeights, gaWeights));
+  }
+  return i;
+}
+
+bool hasAvx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+template <unsigned CHANNELS>
+void grayscalePixels(const uint8_t* src,
+                     uint8_t* dst,
+                     size_t pixels,
+                     FixedWeights w) {
+  size_t done = 0;
+#ifdef GRAYSCALE_HAS_AVX2_KERNELS
+  if (hasAvx2()) {
+    if constexpr (CHANNELS == 3) {
+      done = grayscaleRgbAvx2(src, dst, pixels, w);
+    } else if constexpr (CHANNELS == 4) {
+      done = grayscaleRgbaAvx2(src, dst, pixels, w);
+    }
+  }
+#endif
+  grayscaleScalar<CHANNELS>(src + done * CHANNELS, dst + done, pixels - done,
+                            w);
+}
+
+}  // namespace
+
+void grayscale(const uint8_t* src,
+               uint8_t* dst,
+               size_t pixels,
+               unsigned channels,
+               GrayscaleWeights weights) {
+  const auto w = fixedWeights(weights);
+  switch (channels) {
+    case 1:
+      std::memcpy(dst, src, pixels);
+      return;
+    case 2:
+      for (size_t i = 0; i < pixels; ++i) {
+        dst[i] = src[i * 2];
+      }
+      return;
+    case 3:
+      grayscalePixels<3>(src, dst, pixels, w);
+      return;
+    case 4:
+      grayscalePixels<4>(src, dst, pixels, w);
+      return;
+  }
+  throw std::invalid_argument("grayscale: unsupported channel count " +
+                              std::to_string(channels));
+}
 
-Mat<uint8_t> grayscale(const Mat<uint8_t>& image) {
+Mat<uint8_t> grayscale(const Mat<uint8_t>& image, GrayscaleWeights weights) {
   const auto height = img::height(image);
   const auto width = img::width(image);
-  const auto channel = std::min<unsigned>(img::channel(image), 3);
-  Mat<uint8_t> output = { { height, width, 1 } };
-
-  for (unsigned y = 0; y < height; ++y) {
-    for (unsigned x = 0; x < width; ++x) {
-      unsigned sum = 0;
-      for (unsigned c = 0; c < channel; ++c) {
-        sum += image[y][x][c];
-      }
-      output[y][x][0] = std::round(sum / 3.0);
-    }
+  const auto channel = img::channel(image);
+  if (!image.isContiguous() &&
+      (image.stride(2) != 1 || image.stride(1) != channel)) {
+    return grayscale(Mat<uint8_t>(image), weights);
+  }
+  auto output = Mat<uint8_t>::uninitialized({ height, width, 1 });
+
+  const uint8_t* src = image.data();
+  uint8_t* dst = output.data();
+  if (image.isContiguous()) {
+    parallelFor(height * width, 1 << 18,
+                [&](size_t begin, size_t end, unsigned) {
+                  grayscale(src + begin * channel, dst + begin, end - begin,
+                            channel, weights);
+                });
+    return output;
   }
+  // Packed pixels in padded rows, e.g. a borrowed frame buffer
+  const size_t pitch = image.stride(0);
+  parallelFor(height, std::max<size_t>(1, (1 << 18) / width),
+              [&](size_t begin, size_t end, unsigned) {
+                for (size_t y = begin; y < end; ++y) {
+                  grayscale(src + y * pitch, dst + y * width, width, channel,
+                            weights);
+                }
+              });
   return output;
 }
@@ -1,6 +1,30 @@
 #pragma once
-#include "convolute.hpp"
+#include <cstddef>
+#include <cstdint>
+
 #include "mat.hpp"
 
-Mat<uint8_t> grayscale(const Mat<uint8_t>& image);
+enum class GrayscaleWeights {
+  AVERAGE,  // (R + G + B) / 3
+  BT601,    // 0.299 R + 0.587 G + 0.114 B
+  BT709,    // 0.2126 R + 0.7152 G + 0.0722 B
+};
+
+/**
+ * Converts interleaved pixels to single-channel luma with Q15 fixed-point
+ * weights. 3 and 4 channel input (the 4th being alpha, which is ignored) use
+ * AVX2 kernels when the CPU supports them. 1 channel input is copied and
+ * 2 channel (gray + alpha) input keeps its gray channel. Alpha never
+ * contributes; the earlier implementation averaged gray and alpha as
+ * (gray + alpha) / 3 for 2 channels and divided 1 channel input by three.
+ *
+ * @throws std::invalid_argument for any other channel count
+ */
+void grayscale(const uint8_t* src,
+               uint8_t* dst,
+               size_t pixels,
+               unsigned channels,
+               GrayscaleWeights weights = GrayscaleWeights::AVERAGE);
 
+Mat<uint8_t> grayscale(const Mat<uint8_t>& image,
+                       GrayscaleWeights weights = GrayscaleWeights::AVERAGE);
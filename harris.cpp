@@ -1,6 +1,12 @@
+#include "harris.hpp"
+
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
+#include <string>
 #include "sobel.hpp"
 #include "img.hpp"
+#include "parallel.hpp"
 #include "utility.hpp"
 
 std::vector<std::pair<unsigned, unsigned>> harris(Mat<uint8_t>& input) {
@@ -49,3 +55,114 @@ std::vector<std::pair<unsigned, unsigned>> harris(Mat<uint8_t>& input) {
   }
   return coordinates;
 }
+
+namespace {
+
+// Scores one row of averaged tensor components [xx xy; xy yy].
+void scoreRow(const float* xx,
+              const float* xy,
+              const float* yy,
+              float* out,
+              unsigned width,
+              const CornerOptions& options) {
+  switch (options.score) {
+    case CornerScore::HARRIS: {
+      const float k = options.k;
+      for (unsigned x = 0; x < width; ++x) {
+        const float trace = xx[x] + yy[x];
+        out[x] = xx[x] * yy[x] - xy[x] * xy[x] - k * trace * trace;
+      }
+      return;
+    }
+    case CornerScore::SHI_TOMASI:
+      for (unsigned x = 0; x < width; ++x) {
+        const float half = 0.5f * (xx[x] - yy[x]);
+        out[x] = 0.5f * (xx[x] + yy[x]) -
+                 std::sqrt(half * half + xy[x] * xy[x]);
+      }
+      return;
+    case CornerScore::NOBLE:
+      // The epsilon keeps flat regions at 0 instead of 0 / 0
+      for (unsigned x = 0; x < width; ++x) {
+        out[x] = (xx[x] * yy[x] - xy[x] * xy[x]) / (xx[x] + yy[x] + 1e-6f);
+      }
+      return;
+  }
+}
+
+}  // namespace
+
+Mat<float> cornerResponse(const Mat<uint8_t>& image,
+                          const CornerOptions& options) {
+  if (img::channel(image) != 1) {
+    throw std::invalid_argument("cornerResponse: image needs 1 channel");
+  }
+  const unsigned height = img::height(image), width = img::width(image);
+  const unsigned radius = options.radius;
+  if (radius >= height || radius >= width) {
+    throw std::invalid_argument("cornerResponse: radius " +
+                                std::to_string(radius) +
+                                " does not fit the image");
+  }
+
+  // Tensor components, one plane each
+  const size_t pixels = size_t(height) * width;
+  std::vector<float> products(3 * pixels);
+  {
+    const auto [gradientX, gradientY] = sobelXYGradients(image);
+    const double* gx = gradientX.data();
+    const double* gy = gradientY.data();
+    parallelFor(pixels, 1 << 16, [&](size_t begin, size_t end, unsigned) {
+      for (size_t i = begin; i < end; ++i) {
+        products[i] = float(gx[i] * gx[i]);
+        products[pixels + i] = float(gx[i] * gy[i]);
+        products[2 * pixels + i] = float(gy[i] * gy[i]);
+      }
+    });
+  }
+
+  auto output = Mat<float>::uninitialized({ height, width, 1 });
+  const float scale = 1.f / ((2 * radius + 1) * (2 * radius + 1));
+  const size_t padded = width + 2 * radius;
+  parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / width),
+      [&](size_t begin, size_t end, unsigned) {
+        // Column sums with mirrored margins, then the box sums
+        std::vector<float> columns(3 * padded), boxes(3 * width);
+        for (size_t y = begin; y < end; ++y) {
+          std::fill(columns.begin(), columns.end(), 0.f);
+          for (int dy = -int(radius); dy <= int(radius); ++dy) {
+            const size_t row = size_t(mirror(int(y) + dy, int(height))) * width;
+            for (unsigned plane = 0; plane < 3; ++plane) {
+              const float* in = products.data() + plane * pixels + row;
+              float* sums = columns.data() + plane * padded + radius;
+              for (unsigned x = 0; x < width; ++x) {
+                sums[x] += in[x];
+              }
+            }
+          }
+          for (unsigned plane = 0; plane < 3; ++plane) {
+            float* sums = columns.data() + plane * padded + radius;
+            for (unsigned i = 1; i <= radius; ++i) {
+              sums[-int(i)] = sums[i];
+              sums[width - 1 + i] = sums[width - 1 - i];
+            }
+            float* box = boxes.data() + plane * width;
+            std::fill(box, box + width, 0.f);
+            for (unsigned d = 0; d <= 2 * radius; ++d) {
+              const float* shifted = sums - radius + d;
+              for (unsigned x = 0; x < width; ++x) {
+                box[x] += shifted[x];
+              }
+            }
+            for (unsigned x = 0; x < width; ++x) {
+              box[x] *= scale;
+            }
+          }
+          scoreRow(boxes.data(), boxes.data() + width,
+                   boxes.data() + 2 * width, output.data() + y * width, width,
+                   options);
+        }
+      });
+  return output;
+}
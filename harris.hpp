@@ -3,3 +3,34 @@
 #include <vector>
 
 std::vector<std::pair<unsigned, unsigned>> harris(Mat<uint8_t>& input);
+
+enum class CornerScore {
+  // det - k * trace^2
+  HARRIS,
+  // The smaller eigenvalue, in closed form
+  SHI_TOMASI,
+  // det / trace
+  NOBLE,
+};
+
+struct CornerOptions {
+  CornerScore score = CornerScore::HARRIS;
+  // Harris sensitivity; larger values suppress edges harder
+  float k = 0.04f;
+  // The structure tensor is averaged over a (2 * radius + 1)^2 box
+  unsigned radius = 2;
+};
+
+/**
+ * Corner response of every pixel of a grayscale image.
+ *
+ * The structure tensor of the Sobel gradients is averaged over a box with
+ * mirrored borders, row by row: each output row sums its window rows
+ * vertically, then shifted copies horizontally, and scores the three
+ * smoothed components in a single loop over the row.
+ *
+ * @throws std::invalid_argument unless the image has 1 channel and the
+ *         radius is smaller than both image sides
+ */
+Mat<float> cornerResponse(const Mat<uint8_t>& image,
+                          const CornerOptions& options = {});
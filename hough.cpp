@@ -0,0 +1,195 @@
+#include "hough.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+using Gradients = std::pair<Mat<double>, Mat<double>>;
+
+struct Accumulator {
+  unsigned thetaBins, rhoBins;
+  // rho / rhoStep + offset is the rho bin
+  double offset;
+  // Per angle bin, pre-divided by rhoStep
+  std::vector<double> cosines, sines;
+};
+
+Accumulator makeAccumulator(unsigned height,
+                            unsigned width,
+                            const HoughOptions& options) {
+  if (options.thetaBins == 0 || !(options.rhoStep > 0)) {
+    throw std::invalid_argument("houghLines: empty accumulator");
+  }
+  Accumulator accumulator;
+  accumulator.thetaBins = options.thetaBins;
+  const double diagonal = std::hypot(double(height), double(width));
+  const unsigned half = unsigned(std::ceil(diagonal / options.rhoStep));
+  accumulator.rhoBins = 2 * half + 1;
+  accumulator.offset = half;
+  for (unsigned t = 0; t < options.thetaBins; ++t) {
+    const double theta = t * M_PI / options.thetaBins;
+    accumulator.cosines.push_back(std::cos(theta) / options.rhoStep);
+    accumulator.sines.push_back(std::sin(theta) / options.rhoStep);
+  }
+  return accumulator;
+}
+
+// Votes of the edge pixels in rows [begin, end)
+void vote(const Mat<uint8_t>& edges,
+          const Gradients* gradients,
+          const HoughOptions& options,
+          const Accumulator& accumulator,
+          size_t begin,
+          size_t end,
+          uint32_t* cells) {
+  const unsigned width = img::width(edges);
+  const unsigned bins = accumulator.thetaBins;
+  const double thetaStep = M_PI / bins;
+  // Rounding by truncation, as the offset keeps every bin non-negative
+  const double offset = accumulator.offset + 0.5;
+  const unsigned band =
+      gradients ? unsigned(std::ceil(options.angleBand / thetaStep)) : bins;
+  const bool restricted = 2 * band + 1 < bins;
+
+  for (size_t y = begin; y < end; ++y) {
+    const uint8_t* row = edges.data() + y * edges.stride(0);
+    for (unsigned x = 0; x < width; ++x) {
+      if (!row[x]) {
+        continue;
+      }
+      const auto at = [&](unsigned t) {
+        const double rho =
+            x * accumulator.cosines[t] + y * accumulator.sines[t];
+        ++cells[t * accumulator.rhoBins + unsigned(rho + offset)];
+      };
+      const double gx = restricted ? gradients->first[y][x][0] : 0;
+      const double gy = restricted ? gradients->second[y][x][0] : 0;
+      if (!restricted || (gx == 0 && gy == 0)) {
+        for (unsigned t = 0; t < bins; ++t) {
+          at(t);
+        }
+        continue;
+      }
+      // The x kernel of sobelXYGradients() runs right to left. Angles
+      // beyond [0, pi) wrap around: the same line with rho negated, which
+      // the wrapped bin computes for itself.
+      double theta = std::atan2(gy, -gx);
+      if (theta < 0) {
+        theta += M_PI;
+      }
+      const int center = int(std::lround(theta / thetaStep));
+      for (int t = center - int(band); t <= center + int(band); ++t) {
+        at(unsigned((t + int(bins)) % int(bins)));
+      }
+    }
+  }
+}
+
+std::vector<HoughLine> findPeaks(const std::vector<uint32_t>& cells,
+                                 const Accumulator& accumulator,
+                                 const HoughOptions& options) {
+  const int bins = accumulator.thetaBins;
+  const int rhoBins = accumulator.rhoBins;
+  const int radius = options.suppressionRadius;
+  std::vector<HoughLine> lines;
+  for (int t = 0; t < bins; ++t) {
+    for (int r = 0; r < rhoBins; ++r) {
+      const uint32_t votes = cells[t * rhoBins + r];
+      if (votes < options.threshold || votes == 0) {
+        continue;
+      }
+      // Ties go to the first cell in scan order, so a plateau gives one peak
+      bool peak = true;
+      for (int dt = -radius; dt <= radius && peak; ++dt) {
+        for (int dr = -radius; dr <= radius; ++dr) {
+          int nt = t + dt, nr = r + dr;
+          // Angles wrap around: (rho, theta +- pi) is the line (-rho,
+          // theta), whose bin mirrors the rho bin around the offset
+          if (nt < 0 || nt >= bins) {
+            nt = nt < 0 ? nt + bins : nt - bins;
+            nr = rhoBins - 1 - nr;
+          }
+          if (nt < 0 || nt >= bins || nr < 0 || nr >= rhoBins ||
+              (nt == t && nr == r)) {
+            continue;
+          }
+          const uint32_t other = cells[nt * rhoBins + nr];
+          const bool before = nt < t || (nt == t && nr < r);
+          if (other > votes || (before && other == votes)) {
+            peak = false;
+            break;
+          }
+        }
+      }
+      if (peak) {
+        lines.push_back({ (r - accumulator.offset) * options.rhoStep,
+                          t * M_PI / bins, votes });
+      }
+    }
+  }
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const HoughLine& a, const HoughLine& b) {
+                     return a.votes > b.votes;
+                   });
+  if (options.maxLines && lines.size() > options.maxLines) {
+    lines.resize(options.maxLines);
+  }
+  return lines;
+}
+
+std::vector<HoughLine> hough(const Mat<uint8_t>& edges,
+                             const Gradients* gradients,
+                             const HoughOptions& options) {
+  if (img::channel(edges) != 1) {
+    throw std::invalid_argument("houghLines: edge map needs 1 channel");
+  }
+  if (edges.stride(1) != 1) {
+    return hough(Mat<uint8_t>(edges), gradients, options);
+  }
+  const unsigned height = img::height(edges);
+  const unsigned width = img::width(edges);
+  if (gradients && (img::height(gradients->first) != height ||
+                    img::width(gradients->first) != width ||
+                    gradients->first.shape() != gradients->second.shape())) {
+    throw std::invalid_argument("houghLines: gradients do not match edges");
+  }
+  const auto accumulator = makeAccumulator(height, width, options);
+  const size_t size = size_t(accumulator.thetaBins) * accumulator.rhoBins;
+
+  // One accumulator per strip: voting needs no synchronization
+  std::vector<std::vector<uint32_t>> partials(maxChunks());
+  const unsigned chunks = parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / std::max(1u, width)),
+      [&](size_t begin, size_t end, unsigned chunk) {
+        partials[chunk].assign(size, 0);
+        vote(edges, gradients, options, accumulator, begin, end,
+             partials[chunk].data());
+      });
+  auto& cells = partials[0];
+  parallelFor(size, 1 << 16, [&](size_t begin, size_t end, unsigned) {
+    for (unsigned chunk = 1; chunk < chunks; ++chunk) {
+      const uint32_t* partial = partials[chunk].data();
+      for (size_t i = begin; i < end; ++i) {
+        cells[i] += partial[i];
+      }
+    }
+  });
+  return findPeaks(cells, accumulator, options);
+}
+
+}  // namespace
+
+std::vector<HoughLine> houghLines(const Mat<uint8_t>& edges,
+                                  const HoughOptions& options) {
+  return hough(edges, nullptr, options);
+}
+
+std::vector<HoughLine> houghLines(const Mat<uint8_t>& edges,
+                                  const Gradients& gradients,
+                                  const HoughOptions& options) {
+  return hough(edges, &gradients, options);
+}
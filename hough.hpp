@@ -0,0 +1,55 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "mat.hpp"
+
+// The line x * cos(theta) + y * sin(theta) = rho, theta in [0, pi).
+struct HoughLine {
+  double rho, theta;
+  unsigned votes;
+};
+
+struct HoughOptions {
+  // Accumulator resolution
+  double rhoStep = 1;
+  unsigned thetaBins = 180;
+  // Fewest votes for a line
+  unsigned threshold = 100;
+  // Peaks must be the maximum of the (2 * radius + 1)^2 accumulator cells
+  // around them
+  unsigned suppressionRadius = 2;
+  // At most this many lines, strongest first; 0 for all of them
+  unsigned maxLines = 0;
+  // With gradients, each pixel only votes for angles within this many
+  // radians of its gradient direction
+  double angleBand = M_PI / 18;
+};
+
+/**
+ * Hough line transform over the non-zero pixels of an edge map, such as
+ * canny() output.
+ *
+ * Sines and cosines are tabulated once per angle bin. Row strips vote into
+ * their own accumulators, which are summed at the end, and peaks are
+ * cells at or above the threshold that are the maximum of their
+ * neighbourhood. Neighbourhoods wrap from theta = pi back to 0 with rho
+ * negated, so a line close to vertical is reported once. Edge maps whose
+ * rows are not packed are copied first.
+ */
+std::vector<HoughLine> houghLines(const Mat<uint8_t>& edges,
+                                  const HoughOptions& options = {});
+
+/**
+ * As above, but every edge pixel only votes within options.angleBand of
+ * its gradient direction, since the line through an edge pixel runs across
+ * the gradient. With the default band that is a ninth of the votes.
+ *
+ * @param gradients x and y gradients as sobelXYGradients() returns them
+ */
+std::vector<HoughLine> houghLines(
+    const Mat<uint8_t>& edges,
+    const std::pair<Mat<double>, Mat<double>>& gradients,
+    const HoughOptions& options = {});
@@ -1,8 +1,16 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <csetjmp>
 #include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "grayscale.hpp"
 #include "libpng_wrapper.hpp"
 #include "mat.hpp"
+#include "pnm.hpp"
 #include "utility.hpp"
 
 namespace img {
@@ -21,81 +29,333 @@ typename Mat<V>::size_type channel(const Mat<V>& image) {
   return image.dimension(2);
 }
 
-inline Mat<uint8_t> read(const std::string& name) {
-  auto img = libpng::read(name);
-  const unsigned width = png_get_image_width(img.png, img.info);
-  const unsigned height = png_get_image_height(img.png, img.info);
+// Lower-cased file extension without the dot, or "" if there is none.
+inline std::string extension(const std::string& name) {
+  const auto dot = name.find_last_of('.');
+  const auto slash = name.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return "";
+  }
+  std::string ext = name.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ext;
+}
+
+inline bool isPnm(const std::string& name) {
+  const auto ext = extension(name);
+  return ext == "pgm" || ext == "ppm" || ext == "pnm";
+}
 
+struct ReadOptions {
+  // Decode straight to one 8-bit gray channel inside libpng's transform
+  // pipeline (alpha is stripped), so full-color rows are never stored.
+  bool grayscale = false;
+  GrayscaleWeights weights = GrayscaleWeights::AVERAGE;
+};
+
+/**
+ * Sets up the transforms every PNG read goes through and updates the info
+ * struct to describe the decoded rows: palette images are expanded to RGB,
+ * low bit-depth gray to 8 bits and 16-bit samples are reduced to 8 bits.
+ *
+ * @param deinterlace Let libpng assemble Adam7 passes into full rows. Without
+ *                    it, interlaced images are read pass by pass.
+ */
+inline void setupPngTransforms(libpng::Image& img,
+                               const ReadOptions& options,
+                               bool deinterlace = true) {
+  // Only trivially destructible locals below, see libpng::jumpOnError()
+  if (setjmp(png_jmpbuf(img.png))) {
+    libpng::clean(img);
+    throw libpng::error();
+  }
   const auto colorType = png_get_color_type(img.png, img.info);
-  unsigned channels = 1;
-  switch (colorType) {
-    case PNG_COLOR_TYPE_RGB:
-      channels = 3;
-      break;
-    case PNG_COLOR_TYPE_RGB_ALPHA:
-      channels = 4;
-      break;
-  }
-  Mat<uint8_t> ret({ height, width, channels },
-                   std::vector<uint8_t>(width * height * channels));
-
-  unsigned index = 0;
-  for (unsigned y = 0; y < height; ++y) {
-    for (unsigned x = 0; x < width; ++x) {
-      for (unsigned c = 0; c < channels; ++c) {
-        const auto value = img.buffer[y][x * channels + c];
-        ret(index, value);
-        ++index;
+
+  png_set_palette_to_rgb(img.png);
+  png_set_expand_gray_1_2_4_to_8(img.png);
+  png_set_strip_16(img.png);
+  if (options.grayscale) {
+    if (colorType & (PNG_COLOR_MASK_COLOR | PNG_COLOR_MASK_PALETTE)) {
+      // Red and green coefficients in units of 1/100000
+      png_fixed_point red = 33333, green = 33333;
+      switch (options.weights) {
+        case GrayscaleWeights::AVERAGE:
+          break;
+        case GrayscaleWeights::BT601:
+          red = 29900, green = 58700;
+          break;
+        case GrayscaleWeights::BT709:
+          red = 21260, green = 71520;
+          break;
       }
+      png_set_rgb_to_gray_fixed(img.png, PNG_ERROR_ACTION_NONE, red, green);
     }
+    png_set_strip_alpha(img.png);
   }
-
-  libpng::clean(img);
-  return ret;
+  if (deinterlace) {
+    png_set_interlace_handling(img.png);
+  }
+  png_read_update_info(img.png, img.info);
 }
 
-inline void write(const Mat<uint8_t>& image,
-           const std::string& name,
-           uint8_t type = PNG_COLOR_TYPE_RGB) {
-  auto pngPtr =
-      png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+/**
+ * Decodes the rows of an opened PNG into a height x width x channels Mat and
+ * releases `img`. Rows are decoded directly into the Mat's storage.
+ */
+inline Mat<uint8_t> decodePng(libpng::Image& img,
+                              const ReadOptions& options = {}) {
+  try {
+    const unsigned width = png_get_image_width(img.png, img.info);
+    const unsigned height = png_get_image_height(img.png, img.info);
+    setupPngTransforms(img, options);
+
+    const unsigned channels = png_get_channels(img.png, img.info);
+    assert(png_get_rowbytes(img.png, img.info) == width * channels);
+    auto ret = Mat<uint8_t>::uninitialized({ height, width, channels });
+
+    std::vector<png_bytep> rows(height);
+    for (unsigned y = 0; y < height; ++y) {
+      rows[y] = ret.data() + size_t(y) * width * channels;
+    }
+    libpng::readRows(img, rows.data());
 
-  if (!pngPtr) {
-    throw std::runtime_error("Unable to write image");
+    libpng::clean(img);
+    return ret;
+  } catch (...) {
+    libpng::clean(img);
+    throw;
   }
-  png_infop infoPtr = png_create_info_struct(pngPtr);
+}
 
-  const auto height = image.dimension(0);
-  const auto width = image.dimension(1);
-  const auto channel = image.dimension(2);
+inline Mat<uint8_t> readPng(const std::string& name,
+                            const ReadOptions& options = {}) {
+  auto img = libpng::open(name);
+  return decodePng(img, options);
+}
 
-  libpng::HeaderChunk header = { width, height, type };
-  libpng::writeHeaderChunk(pngPtr, infoPtr, header);
+/**
+ * Decodes a PNG held in memory, e.g. an uploaded request body, exactly like
+ * reading it from a file would.
+ *
+ * @throws std::runtime_error if the buffer is not a complete, valid PNG
+ */
+inline Mat<uint8_t> decode(const uint8_t* data,
+                           size_t size,
+                           const ReadOptions& options = {}) {
+  libpng::MemoryReader source = { data, size };
+  auto img = libpng::open(source);
+  return decodePng(img, options);
+}
 
-  // Allocate buffer
-  auto rows = (png_bytepp)png_malloc(pngPtr, height * (sizeof(png_bytep)));
-  auto rowbytes = png_get_rowbytes(pngPtr, infoPtr);
+inline Mat<uint8_t> decode(const std::vector<uint8_t>& buffer,
+                           const ReadOptions& options = {}) {
+  return decode(buffer.data(), buffer.size(), options);
+}
 
-  for (png_uint_32 i = 0; i < height; i++) {
-    rows[i] = (png_bytep)png_malloc(pngPtr, rowbytes);
-  }
+// libpng reads rows straight out of a Mat whose pixels are packed in rows.
+inline bool hasPackedRows(const Mat<uint8_t>& image) {
+  return image.dimension(0) == 0 ||
+         (image.stride(2) == 1 && image.stride(1) == image.dimension(2));
+}
 
-  unsigned index = 0;
-  for (unsigned y = 0; y < height; ++y) {
-    for (unsigned x = 0; x < width; ++x) {
-      for (unsigned c = 0; c < channel; ++c) {
-        const auto value = image(index);
-        rows[y][x * channel + c] = value;
-        ++index;
-      }
+/**
+ * Encodes image through a write struct whose output is already set up, and
+ * releases the structures. The image must have packed rows.
+ */
+inline void encodePng(png_structp pngPtr,
+                      png_infop infoPtr,
+                      const Mat<uint8_t>& image,
+                      uint8_t type,
+                      uint8_t interlace) {
+  try {
+    const auto height = image.dimension(0);
+    const auto width = image.dimension(1);
+    const auto channel = image.dimension(2);
+
+    libpng::HeaderChunk header = { width, height, type };
+    header.interlaceType = interlace;
+    libpng::writeHeaderChunk(pngPtr, infoPtr, header);
+    if (png_get_rowbytes(pngPtr, infoPtr) != width * channel) {
+      throw std::invalid_argument("PNG color type does not match the " +
+                                  std::to_string(channel) +
+                                  " channel image");
+    }
+
+    std::vector<png_bytep> rows(height);
+    for (unsigned y = 0; y < height; ++y) {
+      rows[y] = const_cast<png_bytep>(image.data() + y * image.stride(0));
     }
+    libpng::writeRows(pngPtr, infoPtr, rows.data());
+  } catch (...) {
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+    throw;
+  }
+  png_destroy_write_struct(&pngPtr, &infoPtr);
+}
+
+inline void writePng(const Mat<uint8_t>& image,
+                     const std::string& name,
+                     uint8_t type = PNG_COLOR_TYPE_RGB,
+                     uint8_t interlace = PNG_INTERLACE_NONE) {
+  if (!hasPackedRows(image)) {
+    writePng(Mat<uint8_t>(image), name, type, interlace);
+    return;
   }
 
-  png_set_rows(pngPtr, infoPtr, rows);
   FILE* file = fopen(name.c_str(), "wb");
-  png_init_io(pngPtr, file);
-  png_write_png(pngPtr, infoPtr, PNG_TRANSFORM_IDENTITY, NULL);
+  if (!file) {
+    throw std::runtime_error("Unable to create " + name);
+  }
+  try {
+    auto [pngPtr, infoPtr] = libpng::initializeWriteStructAndInfoPtr();
+    png_init_io(pngPtr, file);
+    encodePng(pngPtr, infoPtr, image, type, interlace);
+  } catch (...) {
+    fclose(file);
+    throw;
+  }
   fclose(file);
 }
 
+/**
+ * Encodes image as a PNG in memory. The buffer is reserved up front for the
+ * largest stream deflate can produce for the image (stored blocks plus
+ * chunk overhead), so encoding never reallocates.
+ */
+inline std::vector<uint8_t> encode(const Mat<uint8_t>& image,
+                                   uint8_t type = PNG_COLOR_TYPE_RGB,
+                                   uint8_t interlace = PNG_INTERLACE_NONE) {
+  if (!hasPackedRows(image)) {
+    return encode(Mat<uint8_t>(image), type, interlace);
+  }
+  // Each row gains a filter byte (Adam7's seven passes add up to fewer than
+  // 2 * height + 7 rows). The zlib stream stays within compressBound(),
+  // which allows for stored blocks as short as zlib's 16 KiB buffer; every
+  // 8 KiB IDAT chunk adds 12 bytes, and the signature, IHDR and IEND fit in
+  // the last 1 KiB.
+  const size_t height = image.dimension(0);
+  const size_t rows =
+      interlace == PNG_INTERLACE_NONE ? height : 2 * height + 7;
+  const size_t filtered = image.size() + rows;
+  const size_t deflated = filtered + (filtered >> 12) + (filtered >> 14) +
+                          (filtered >> 25) + 13;
+  const size_t bound = deflated + (deflated / 8192 + 1) * 12 + 1024;
+
+  std::vector<uint8_t> output;
+  output.reserve(bound);
+  auto [pngPtr, infoPtr] = libpng::initializeWriteStructAndInfoPtr();
+  libpng::writeTo(pngPtr, output);
+  encodePng(pngPtr, infoPtr, image, type, interlace);
+  return output;
+}
+
+struct ImageInfo {
+  unsigned width, height;
+  // Channels of the Mat read() returns for the options probe() was given
+  unsigned channels;
+  // Bits per sample as stored; read() always returns 8-bit samples
+  unsigned bitDepth;
+  bool interlaced;
+  // Element storage of that Mat, and the pool block read() allocates for
+  // it; 0 when read() adopts the mapping of a PNM file
+  size_t bytes;
+  size_t allocatedBytes;
+};
+
+/**
+ * Reports what read(name, options) would return without decoding any pixel
+ * data: PNGs are read up to the end of their header chunks, PNM headers are
+ * parsed from a mapping whose sample pages are never touched.
+ *
+ * Meant for admitting images against a memory budget before reading them.
+ *
+ * @throws std::invalid_argument for headerless .raw files, like read()
+ */
+inline ImageInfo probe(const std::string& name,
+                       const ReadOptions& options = {}) {
+  ImageInfo info;
+  if (isPnm(name)) {
+    const pnm::MappedFile file(name);
+    const auto header = pnm::parseHeader(file.data(), file.size());
+    info.width = header.width;
+    info.height = header.height;
+    info.channels = options.grayscale ? 1 : header.channels;
+    info.bitDepth = 8;
+    info.interlaced = false;
+    info.bytes = size_t(info.width) * info.height * info.channels;
+    // read() adopts the mapping unless it has to convert to grayscale
+    info.allocatedBytes = info.channels == header.channels
+                              ? 0
+                              : MatPool::sizeClass(info.bytes);
+    return info;
+  }
+  if (extension(name) == "raw") {
+    throw std::invalid_argument("Use img::readRaw() to read " + name);
+  }
+  auto img = libpng::open(name);
+  try {
+    info.width = png_get_image_width(img.png, img.info);
+    info.height = png_get_image_height(img.png, img.info);
+    info.bitDepth = png_get_bit_depth(img.png, img.info);
+    info.interlaced =
+        png_get_interlace_type(img.png, img.info) != PNG_INTERLACE_NONE;
+    setupPngTransforms(img, options);
+    info.channels = png_get_channels(img.png, img.info);
+  } catch (...) {
+    libpng::clean(img);
+    throw;
+  }
+  libpng::clean(img);
+  info.bytes = size_t(info.width) * info.height * info.channels;
+  info.allocatedBytes = MatPool::sizeClass(info.bytes);
+  return info;
+}
+
+/**
+ * Reads an image, picking the decoder by extension: .pgm/.ppm/.pnm are
+ * memory-mapped binary PNM files, anything else is decoded as PNG.
+ * Headerless .raw files carry no dimensions; use readRaw() for those.
+ */
+inline Mat<uint8_t> read(const std::string& name,
+                         const ReadOptions& options = {}) {
+  if (isPnm(name)) {
+    auto image = pnm::read(name);
+    if (options.grayscale && channel(image) != 1) {
+      return grayscale(image, options.weights);
+    }
+    return image;
+  }
+  if (extension(name) == "raw") {
+    throw std::invalid_argument("Use img::readRaw() to read " + name);
+  }
+  return readPng(name, options);
+}
+
+inline Mat<uint8_t> readRaw(const std::string& name,
+                            unsigned height,
+                            unsigned width,
+                            unsigned channels) {
+  return pnm::readRaw(name, height, width, channels);
+}
+
+/**
+ * Writes an image, picking the encoder by extension: .pgm/.ppm/.pnm as
+ * binary PNM, .raw as the bare samples, anything else as PNG with the given
+ * color type. PNM and raw output is a straight copy of the Mat's storage,
+ * which makes them the cheap choice for intermediate files. Borrowed and
+ * strided Mats are written without an intermediate copy of the frame.
+ */
+inline void write(const Mat<uint8_t>& image,
+                  const std::string& name,
+                  uint8_t type = PNG_COLOR_TYPE_RGB) {
+  if (isPnm(name)) {
+    pnm::write(image, name);
+  } else if (extension(name) == "raw") {
+    pnm::writeRaw(image, name);
+  } else {
+    writePng(image, name, type);
+  }
+}
+
 }  // namespace img
@@ -1,40 +1,102 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 
+#include "mat.hpp"
 #include "mat_view_2d.hpp"
 
+/**
+ * Summed-area table of a single channel image, optionally with a second
+ * table of squared values for window variances.
+ *
+ * Sums are 64-bit, so squares of 8-bit images do not overflow even at
+ * hundreds of megapixels. The tables carry a leading row and column of
+ * zeros, so window lookups need no bounds tests.
+ */
 class IntegralImage {
  public:
   template <typename E>
   IntegralImage(const MatView2D<E>& mat)
-      : mData(mat.height(), std::vector<int>(mat.width(), 0)) {
-
+      : mWidth(mat.width() + 1),
+        mSums(size_t(mat.height() + 1) * mWidth, 0) {
     for (unsigned y = 0; y < mat.height(); ++y) {
-      int sum = 0;
+      int64_t sum = 0;
       for (unsigned x = 0; x < mat.width(); ++x) {
         sum += mat[y][x];
-        this->mData[y][x] = sum;
+        mSums[(y + 1) * mWidth + x + 1] = mSums[y * mWidth + x + 1] + sum;
       }
     }
+  }
 
-    for (unsigned x = 0; x < mat.width(); ++x) {
-      int sum = 0;
-      for (unsigned y = 0; y < mat.height(); ++y) {
-        sum += this->mData[y][x];
-        this->mData[y][x] = sum;
+  /**
+   * Reads the samples straight from a height x width x 1 Mat.
+   *
+   * @param squares Also build the table of squared values, for
+   *                getSquaredSum()
+   */
+  template <typename E>
+  explicit IntegralImage(const Mat<E>& mat, bool squares = false)
+      : mWidth(mat.dimension(1) + 1),
+        mSums(size_t(mat.dimension(0) + 1) * mWidth, 0) {
+    if (mat.dimension(2) != 1) {
+      throw std::invalid_argument("IntegralImage needs a single channel");
+    }
+    if (squares) {
+      mSquares.assign(mSums.size(), 0);
+    }
+    const size_t height = mat.dimension(0), width = mat.dimension(1);
+    for (size_t y = 0; y < height; ++y) {
+      const E* row = mat.data() + y * mat.stride(0);
+      const size_t stride = mat.stride(1);
+      const int64_t* above = mSums.data() + y * mWidth + 1;
+      int64_t* sums = mSums.data() + (y + 1) * mWidth + 1;
+      int64_t sum = 0;
+      for (size_t x = 0; x < width; ++x) {
+        sum += row[x * stride];
+        sums[x] = above[x] + sum;
+      }
+      if (squares) {
+        const int64_t* squaresAbove = mSquares.data() + y * mWidth + 1;
+        int64_t* squareSums = mSquares.data() + (y + 1) * mWidth + 1;
+        int64_t squareSum = 0;
+        for (size_t x = 0; x < width; ++x) {
+          const int64_t value = row[x * stride];
+          squareSum += value * value;
+          squareSums[x] = squaresAbove[x] + squareSum;
+        }
       }
     }
   }
 
-  int getSum(unsigned x0, unsigned y0, unsigned x1, unsigned y1) const {
-    const int a = (x0 == 0 || y0 == 0) ? 0 : this->mData[y0 - 1][x0 - 1];
-    const int b = (y0 == 0 || x1 == 0) ? 0 : this->mData[y0 - 1][x1];
-    const int c = (y1 == 0 || x0 == 0) ? 0 : this->mData[y1][x0 - 1];
-    const int d = (y1 == 0 || x1 == 0) ? 0 : this->mData[y1][x1];
+  // Sum over [x0, x1] x [y0, y1], both corners included.
+  int64_t getSum(unsigned x0, unsigned y0, unsigned x1, unsigned y1) const {
+    return window(mSums, x0, y0, x1, y1);
+  }
 
-    return d + a - b - c;
+  // Sum of squares over the same window; needs the squares table.
+  int64_t getSquaredSum(unsigned x0,
+                        unsigned y0,
+                        unsigned x1,
+                        unsigned y1) const {
+    return window(mSquares, x0, y0, x1, y1);
   }
 
+  bool hasSquares() const { return !mSquares.empty(); }
+
  private:
-  std::vector<std::vector<int>> mData;
+  int64_t window(const std::vector<int64_t>& table,
+                 unsigned x0,
+                 unsigned y0,
+                 unsigned x1,
+                 unsigned y1) const {
+    const size_t top = size_t(y0) * mWidth, bottom = size_t(y1 + 1) * mWidth;
+    return table[bottom + x1 + 1] - table[bottom + x0] - table[top + x1 + 1] +
+           table[top + x0];
+  }
+
+  size_t mWidth;
+  std::vector<int64_t> mSums;
+  std::vector<int64_t> mSquares;
 };
@@ -0,0 +1,226 @@
+#include "labeling.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Foreground pixels [begin, end) of one row
+struct Run {
+  unsigned row, begin, end;
+};
+
+class UnionFind {
+ public:
+  explicit UnionFind(std::vector<uint32_t>& parent) : mParent(parent) {}
+
+  uint32_t find(uint32_t node) {
+    while (mParent[node] != node) {
+      // Path halving
+      mParent[node] = mParent[mParent[node]];
+      node = mParent[node];
+    }
+    return node;
+  }
+
+  // The smaller index becomes the root, so every root is the first run of
+  // its component in raster order.
+  void join(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a < b) {
+      mParent[b] = a;
+    } else if (b < a) {
+      mParent[a] = b;
+    }
+  }
+
+ private:
+  std::vector<uint32_t>& mParent;
+};
+
+/**
+ * Joins every run in [current, currentEnd) with the runs of the row above,
+ * [previous, previousEnd), that it touches. With 8-connectivity runs that
+ * only meet diagonally touch too.
+ */
+void joinRows(const std::vector<Run>& runs,
+              uint32_t previous,
+              uint32_t previousEnd,
+              uint32_t current,
+              uint32_t currentEnd,
+              unsigned reach,
+              UnionFind& forest) {
+  uint32_t above = previous;
+  for (uint32_t run = current; run < currentEnd; ++run) {
+    // Runs above that end before this one can reach cannot touch later runs
+    while (above < previousEnd && runs[above].end + reach <= runs[run].begin) {
+      ++above;
+    }
+    for (uint32_t candidate = above;
+         candidate < previousEnd &&
+         runs[candidate].begin < runs[run].end + reach;
+         ++candidate) {
+      forest.join(run, candidate);
+    }
+  }
+}
+
+struct Strip {
+  std::vector<Run> runs;
+  std::vector<uint32_t> parent;
+  // Index of the first run of each row, plus one past the last run
+  std::vector<uint32_t> rowStarts;
+};
+
+void scanStrip(const uint8_t* data,
+               size_t pitch,
+               unsigned width,
+               size_t begin,
+               size_t end,
+               unsigned reach,
+               Strip& strip) {
+  for (size_t y = begin; y < end; ++y) {
+    strip.rowStarts.push_back(uint32_t(strip.runs.size()));
+    const uint8_t* row = data + y * pitch;
+    unsigned x = 0;
+    while (x < width) {
+      while (x < width && !row[x]) {
+        ++x;
+      }
+      if (x == width) {
+        break;
+      }
+      const unsigned start = x;
+      while (x < width && row[x]) {
+        ++x;
+      }
+      strip.runs.push_back({ unsigned(y), start, x });
+    }
+  }
+  strip.rowStarts.push_back(uint32_t(strip.runs.size()));
+
+  strip.parent.resize(strip.runs.size());
+  std::iota(strip.parent.begin(), strip.parent.end(), 0);
+  UnionFind forest(strip.parent);
+  for (size_t row = 1; row + 1 < strip.rowStarts.size(); ++row) {
+    joinRows(strip.runs, strip.rowStarts[row - 1], strip.rowStarts[row],
+             strip.rowStarts[row], strip.rowStarts[row + 1], reach, forest);
+  }
+}
+
+}  // namespace
+
+Components labelComponents(const Mat<uint8_t>& mask,
+                           Connectivity connectivity,
+                           bool computeStats) {
+  if (img::channel(mask) != 1) {
+    throw std::invalid_argument("labelComponents: mask needs 1 channel");
+  }
+  if (mask.stride(1) != 1) {
+    return labelComponents(Mat<uint8_t>(mask), connectivity, computeStats);
+  }
+  const unsigned height = img::height(mask);
+  const unsigned width = img::width(mask);
+  const unsigned reach = connectivity == Connectivity::EIGHT ? 1 : 0;
+
+  // Strips are sized by pixel count rather than by thread count, so the
+  // labels do not depend on how many threads ran.
+  const size_t stripRows =
+      std::max<size_t>(1, (1 << 16) / std::max(1u, width));
+  const size_t stripCount =
+      std::max<size_t>(1, (height + stripRows - 1) / stripRows);
+  std::vector<Strip> strips(stripCount);
+  parallelFor(stripCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t index = begin; index < end; ++index) {
+      scanStrip(mask.data(), mask.stride(0), width, index * stripRows,
+                std::min<size_t>(height, (index + 1) * stripRows), reach,
+                strips[index]);
+    }
+  });
+
+  // One forest over all runs, strips in order, so run indices stay in
+  // raster order.
+  std::vector<uint32_t> offsets(stripCount + 1, 0);
+  for (size_t index = 0; index < stripCount; ++index) {
+    offsets[index + 1] = offsets[index] + uint32_t(strips[index].runs.size());
+  }
+  std::vector<Run> runs;
+  std::vector<uint32_t> parent;
+  runs.reserve(offsets[stripCount]);
+  parent.reserve(offsets[stripCount]);
+  for (size_t index = 0; index < stripCount; ++index) {
+    auto& strip = strips[index];
+    runs.insert(runs.end(), strip.runs.begin(), strip.runs.end());
+    for (uint32_t node : strip.parent) {
+      parent.push_back(node + offsets[index]);
+    }
+    strip.runs = {};
+    strip.parent = {};
+  }
+
+  UnionFind forest(parent);
+  for (size_t index = 1; index < stripCount; ++index) {
+    const auto& above = strips[index - 1].rowStarts;
+    const auto& below = strips[index].rowStarts;
+    if (above.size() < 2 || below.size() < 2) {
+      continue;
+    }
+    joinRows(runs, offsets[index - 1] + above[above.size() - 2],
+             offsets[index - 1] + above.back(), offsets[index] + below[0],
+             offsets[index] + below[1], reach, forest);
+  }
+
+  // Roots come first in raster order, so one forward pass numbers them.
+  Components result{ Mat<uint32_t>::uninitialized({ height, width, 1 }), 0,
+                     {} };
+  std::vector<uint32_t> labels(runs.size());
+  for (uint32_t run = 0; run < runs.size(); ++run) {
+    const uint32_t root = forest.find(run);
+    labels[run] = root == run ? ++result.count : labels[root];
+  }
+
+  if (computeStats) {
+    std::vector<double> sumY(result.count, 0), sumX(result.count, 0);
+    result.stats.assign(result.count, { 0, height, width, 0, 0, 0, 0 });
+    for (uint32_t run = 0; run < runs.size(); ++run) {
+      const auto& r = runs[run];
+      const uint32_t index = labels[run] - 1;
+      const unsigned length = r.end - r.begin;
+      auto& stats = result.stats[index];
+      stats.area += length;
+      stats.top = std::min(stats.top, r.row);
+      stats.bottom = std::max(stats.bottom, r.row + 1);
+      stats.left = std::min(stats.left, r.begin);
+      stats.right = std::max(stats.right, r.end);
+      sumY[index] += double(r.row) * length;
+      sumX[index] += (double(r.begin) + r.end - 1) * length / 2;
+    }
+    for (uint32_t index = 0; index < result.count; ++index) {
+      auto& stats = result.stats[index];
+      stats.centroidY = sumY[index] / stats.area;
+      stats.centroidX = sumX[index] / stats.area;
+    }
+  }
+
+  uint32_t* out = result.labels.data();
+  parallelFor(stripCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t index = begin; index < end; ++index) {
+      const auto& rowStarts = strips[index].rowStarts;
+      for (size_t row = 0; row + 1 < rowStarts.size(); ++row) {
+        uint32_t* line = out + (index * stripRows + row) * width;
+        std::fill(line, line + width, 0);
+        for (uint32_t run = offsets[index] + rowStarts[row];
+             run < offsets[index] + rowStarts[row + 1]; ++run) {
+          std::fill(line + runs[run].begin, line + runs[run].end,
+                    labels[run]);
+        }
+      }
+    }
+  });
+  return result;
+}
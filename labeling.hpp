@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mat.hpp"
+
+enum class Connectivity { FOUR, EIGHT };
+
+struct ComponentStats {
+  size_t area;
+  // Bounding box; bottom and right are one past the last row and column
+  unsigned top, left, bottom, right;
+  // Mean pixel position
+  double centroidY, centroidX;
+};
+
+struct Components {
+  // height x width x 1: 0 for background, 1..count for the components,
+  // numbered in raster order of their first pixel
+  Mat<uint32_t> labels;
+  unsigned count;
+  // stats[label - 1], empty unless requested
+  std::vector<ComponentStats> stats;
+};
+
+/**
+ * Labels the connected components of the non-zero pixels of a single
+ * channel mask, such as canny() output.
+ *
+ * Works on runs of foreground pixels rather than pixels: each row strip
+ * finds its runs and joins overlapping runs of adjacent rows in a
+ * union-find forest on its own thread, then the strips are joined along
+ * their boundary rows and the label image is written in parallel. Stats
+ * come from the runs, so they cost no extra pass over the pixels.
+ *
+ * @throws std::invalid_argument for masks with more than one channel
+ */
+Components labelComponents(const Mat<uint8_t>& mask,
+                           Connectivity connectivity = Connectivity::EIGHT,
+                           bool computeStats = false);
@@ -1,18 +1,38 @@
 #include "libpng_wrapper.hpp"
+#include <csetjmp>
+#include <cstring>
+#include <new>
 #include <stdexcept>
 
 namespace libpng {
-void writeHeaderChunk(png_structp pngPtr,
-                      png_infop infoPtr,
+
+// The functions below that call setjmp() keep no locals with destructors,
+// which the longjmp out of libpng would skip.
+
+void writeHeaderChunk(png_structp& pngPtr,
+                      png_infop& infoPtr,
                       const HeaderChunk& header) {
+  if (setjmp(png_jmpbuf(pngPtr))) {
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+    throw error();
+  }
   png_set_IHDR(pngPtr, infoPtr, header.width, header.height, header.bitDepth,
                header.colorType, header.interlaceType, header.compressionType,
                header.filterMethod);
 }
 
+void writeRows(png_structp& pngPtr, png_infop& infoPtr, png_bytepp rows) {
+  if (setjmp(png_jmpbuf(pngPtr))) {
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+    throw error();
+  }
+  png_set_rows(pngPtr, infoPtr, rows);
+  png_write_png(pngPtr, infoPtr, PNG_TRANSFORM_IDENTITY, NULL);
+}
+
 std::pair<png_structp, png_infop> initializeWriteStructAndInfoPtr() {
   png_structp pngPtr =
-      png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+      png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, jumpOnError, NULL);
 
   if (!pngPtr) {
     throw std::runtime_error("Unable to create image");
@@ -62,7 +82,145 @@ Image read(const std::string& name) {
   return img;
 }
 
+namespace {
+
+// Message of the error being reported, see jumpOnError()
+thread_local char lastError[256];
+
+// Creates the read structures, which report errors through jumpOnError().
+// Closes `file` if that fails.
+Image createReadStruct(FILE* file) {
+  Image img;
+  img.file = file;
+  img.buffer = nullptr;
+  img.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, jumpOnError,
+                                   NULL);
+  if (!img.png) {
+    if (file) {
+      fclose(file);
+    }
+    throw std::runtime_error("Failed to create png pointer");
+  }
+
+  img.info = png_create_info_struct(img.png);
+
+  if (!img.info) {
+    png_destroy_read_struct(&img.png, NULL, NULL);
+    if (file) {
+      fclose(file);
+    }
+    throw std::runtime_error("Failed to create png info pointer");
+  }
+  return img;
+}
+
+// Reads the header chunks, releasing everything if they are malformed.
+void readInfo(Image& img) {
+  if (setjmp(png_jmpbuf(img.png))) {
+    clean(img);
+    throw error();
+  }
+  png_read_info(img.png, img.info);
+}
+
+void readFromMemory(png_structp png, png_bytep out, png_size_t length) {
+  auto& source = *static_cast<MemoryReader*>(png_get_io_ptr(png));
+  if (length > source.size - source.position) {
+    png_error(png, "PNG data is truncated");
+  }
+  std::memcpy(out, source.data + source.position, length);
+  source.position += length;
+}
+
+void writeToMemory(png_structp png, png_bytep data, png_size_t length) {
+  auto& output = *static_cast<std::vector<uint8_t>*>(png_get_io_ptr(png));
+  // Exceptions must not unwind through libpng; report the failure to it
+  // once the handler has finished
+  bool outOfMemory = false;
+  try {
+    output.insert(output.end(), data, data + length);
+  } catch (const std::bad_alloc&) {
+    outOfMemory = true;
+  }
+  if (outOfMemory) {
+    png_error(png, "Out of memory for the encoded PNG");
+  }
+}
+
+void flushMemory(png_structp) {}
+
+}  // namespace
+
+void jumpOnError(png_structp png, png_const_charp message) {
+  std::strncpy(lastError, message, sizeof(lastError) - 1);
+  png_longjmp(png, 1);
+}
+
+std::runtime_error error() {
+  return std::runtime_error(std::string("libpng: ") + lastError);
+}
+
+Image open(const std::string& name) {
+  FILE* file = fopen(name.c_str(), "rb");
+  if (!file) {
+    throw std::runtime_error("Unable to open " + name);
+  }
+  if (!libpng::verifyFormat(file)) {
+    fclose(file);
+    throw std::runtime_error(name + " is not a valid PNG file");
+  }
+  Image img = createReadStruct(file);
+  png_init_io(img.png, file);
+  png_set_sig_bytes(img.png, 8);
+  readInfo(img);
+  return img;
+}
+
+Image open(MemoryReader& source) {
+  if (source.size - source.position < 8 ||
+      png_sig_cmp(source.data + source.position, 0, 8)) {
+    throw std::runtime_error("Buffer does not hold a valid PNG image");
+  }
+  Image img = createReadStruct(nullptr);
+  png_set_read_fn(img.png, &source, readFromMemory);
+  readInfo(img);
+  return img;
+}
+
+void writeTo(png_structp png, std::vector<uint8_t>& output) {
+  png_set_write_fn(png, &output, writeToMemory, flushMemory);
+}
+
+void readRows(Image& img, png_bytepp rows) {
+  if (setjmp(png_jmpbuf(img.png))) {
+    clean(img);
+    throw error();
+  }
+  png_read_image(img.png, rows);
+  png_read_end(img.png, NULL);
+}
+
+void readRow(Image& img, png_bytep row) {
+  if (setjmp(png_jmpbuf(img.png))) {
+    clean(img);
+    throw error();
+  }
+  png_read_row(img.png, row, NULL);
+}
+
+void readEnd(Image& img) {
+  if (setjmp(png_jmpbuf(img.png))) {
+    clean(img);
+    throw error();
+  }
+  png_read_end(img.png, NULL);
+}
+
 void clean(Image& img) {
   png_destroy_read_struct(&img.png, &img.info, NULL);
+  if (img.file) {
+    fclose(img.file);
+    img.file = nullptr;
+  }
 }
 }  // namespace libpng
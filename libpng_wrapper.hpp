@@ -6,6 +6,7 @@ extern "C" {
 #include <string>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 namespace libpng {
 
@@ -13,6 +14,8 @@ struct Image {
   png_structp png;
   png_infop info;
   png_bytepp buffer;
+  // Only set while rows are still to be read, see open()
+  FILE* file = nullptr;
 };
 
 struct HeaderChunk {
@@ -26,12 +29,73 @@ struct HeaderChunk {
   uint8_t filterMethod = PNG_FILTER_TYPE_DEFAULT;
 };
 
-void writeHeaderChunk(png_structp pngPtr,
-                      png_infop infoPtr,
+// A PNG held in memory, consumed from `position` onwards.
+struct MemoryReader {
+  const png_byte* data;
+  size_t size;
+  size_t position = 0;
+};
+
+/**
+ * libpng error callback that records the message and longjmps back to the
+ * setjmp(png_jmpbuf(png)) of the function that called into libpng. That
+ * function releases the structures and only then throws error(), so no
+ * exception ever unwinds through libpng's C frames. Every structure created
+ * here installs it.
+ */
+[[noreturn]] void jumpOnError(png_structp png, png_const_charp message);
+
+// The last message jumpOnError() recorded on this thread.
+std::runtime_error error();
+
+/**
+ * Sets the IHDR of a write struct. Both structures are destroyed and
+ * nulled before the error is thrown if libpng rejects the header.
+ */
+void writeHeaderChunk(png_structp& pngPtr,
+                      png_infop& infoPtr,
                       const HeaderChunk& header);
+
+/**
+ * Encodes `rows`, which must each hold png_get_rowbytes() bytes, to the
+ * output of the write struct. Errors are handled as in writeHeaderChunk().
+ */
+void writeRows(png_structp& pngPtr, png_infop& infoPtr, png_bytepp rows);
 std::pair<png_structp, png_infop> initializeWriteStructAndInfoPtr();
 bool verifyFormat(FILE* file);
 
 Image read(const std::string& name);
+
+/**
+ * Opens a PNG file and reads everything up to the image data (signature,
+ * IHDR and the other header chunks), leaving the file open so that
+ * transforms can be configured before the rows are decoded with readRows().
+ */
+Image open(const std::string& name);
+
+// Same as open(name) for a PNG in memory. `source` must outlive the Image.
+Image open(MemoryReader& source);
+
+/**
+ * Decodes all rows (any interlace passes included) into caller-provided row
+ * pointers, which must each hold png_get_rowbytes() bytes after
+ * png_read_update_info().
+ *
+ * This and the other reading functions clean() `img` before throwing when
+ * libpng reports an error.
+ */
+void readRows(Image& img, png_bytepp rows);
+
+// Decodes the next row, or the next row of the current interlace pass.
+void readRow(Image& img, png_bytep row);
+
+// Reads the chunks after the image data once every row has been read.
+void readEnd(Image& img);
+
+// Sends the encoded stream of a write struct to the end of `output`.
+void writeTo(png_structp png, std::vector<uint8_t>& output);
+
+// Frees the libpng structures and closes the file if it is still open.
+// Calling it again is a no-op.
 void clean(Image& img);
 }  // namespace libpng
@@ -1,10 +1,20 @@
 #pragma once
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <functional>
+#include <initializer_list>
+#include <memory>
 #include <numeric>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+#include "convert.hpp"
+#include "mat_allocator.hpp"
+#include "mat_expr.hpp"
+
 template <typename Element>
 class MatAccessor;
 template <typename Element>
@@ -22,25 +32,109 @@ class Mat {
   template <typename T>
   friend class Mat;
 
+  using value_type = Element;
   using index_t = MatAccessor<Element>;
   using const_index_t = ConstMatAccessor<Element>;
 
-  using iterator = typename std::vector<Element>::iterator;
-  using const_iterator = typename std::vector<Element>::const_iterator;
-  using size_type = typename std::vector<Element>::size_type;
+  // Element storage is 64-byte aligned and drawn from MatPool::global(), so
+  // short-lived intermediates of the same size recycle each other's memory.
+  using allocator_type = MatAllocator<Element>;
+  using storage_t = std::vector<Element, allocator_type>;
+
+  using iterator = Element*;
+  using const_iterator = const Element*;
+  using size_type = typename storage_t::size_type;
+  using deleter_t = std::function<void(Element*)>;
 
   Mat(const std::vector<size_type>& dimensions);
   Mat(const std::vector<size_type>& dimensions,
       const std::vector<Element>& elements);
+  Mat(const std::vector<size_type>& dimensions,
+      std::initializer_list<Element> elements);
+  Mat(const std::vector<size_type>& dimensions, storage_t elements);
 
   Mat(const std::vector<size_type>& dimensions,
       const std::function<Element(unsigned)>& generator);
 
-  iterator begin() { return this->mElements.begin(); }
-  const_iterator cbegin() const { return this->mElements.cbegin(); }
+  /**
+   * Evaluates a lazy arithmetic expression (see mat_expr.hpp) in one pass.
+   * When the expression owns an rvalue Mat<Element> operand, its storage is
+   * reused for the result.
+   */
+  template <typename X, typename = std::enable_if_t<is_mat_expr_v<X>>>
+  Mat(X&& expr);
+
+  /**
+   * Creates a matrix whose elements are left uninitialized, for outputs that
+   * are about to be overwritten in full.
+   */
+  static Mat uninitialized(const std::vector<size_type>& dimensions);
+
+  /**
+   * Wraps a buffer the caller keeps alive for the lifetime of the Mat and of
+   * any Mat moved from it. Nothing is copied.
+   *
+   * @param strides Distance in elements between neighbours along each
+   *                dimension, e.g. { rowPitch, channels, 1 } for padded
+   *                image rows. Empty means densely packed.
+   */
+  static Mat borrow(Element* data,
+                    const std::vector<size_type>& dimensions,
+                    const std::vector<size_type>& strides = {});
+
+  /**
+   * Takes ownership of a buffer: `deleter(data)` runs when the Mat holding
+   * it is destroyed. Strides are as for borrow().
+   */
+  static Mat adopt(Element* data,
+                   const std::vector<size_type>& dimensions,
+                   deleter_t deleter,
+                   const std::vector<size_type>& strides = {});
+
+  // Copies are always owned and densely packed, whatever the source layout.
+  Mat(const Mat& other);
+  Mat(Mat&& other) noexcept;
+  Mat& operator=(const Mat& other);
+  Mat& operator=(Mat&& other) noexcept;
+
+  /**
+   * Iterators and linear indexing need a contiguous Mat and assert it;
+   * compact a strided one by copying it first. Accessors (`m[y][x][c]`),
+   * forEachRun() and copies honour any strides.
+   */
+  bool isContiguous() const { return mContiguous; }
+  size_type stride(unsigned index) const { return mOffsetMultipliers[index]; }
+
+  iterator begin() {
+    assert(mContiguous);
+    return mData;
+  }
+  const_iterator cbegin() const {
+    assert(mContiguous);
+    return mData;
+  }
+
+  iterator end() {
+    assert(mContiguous);
+    return mData + mSize;
+  }
+  const_iterator cend() const {
+    assert(mContiguous);
+    return mData + mSize;
+  }
 
-  iterator end() { return this->mElements.end(); }
-  const_iterator cend() const { return this->mElements.cend(); }
+  // The first element. Element (i, j, ...) of a strided Mat sits at
+  // data()[i * stride(0) + j * stride(1) + ...].
+  Element* data() { return mData; }
+  const Element* data() const { return mData; }
+
+  /**
+   * Calls fn(run, offset, count) for every stretch of elements that is
+   * contiguous in memory, in row-major order. `offset` is the run's index
+   * in a densely packed copy. Contiguous Mats are a single run.
+   */
+  template <typename F>
+  void forEachRun(F&& fn) const;
 
   Element operator()(std::initializer_list<unsigned> indices) const;
 
@@ -48,11 +142,32 @@ class Mat {
   void operator()(unsigned index, const Element& value);
 
   Mat& operator=(const std::initializer_list<Element>& other);
-  Mat& operator+=(const Mat& other);
   Mat& operator+=(const std::initializer_list<Element>& other);
 
-  Mat operator-(const Mat& other);
-  Mat operator+(const Mat& other);
+  /**
+   * Evaluates in place, through any strides, when the shape is unchanged.
+   * Otherwise the result replaces the elements, which a Mat over an
+   * external buffer cannot do.
+   *
+   * @throws std::invalid_argument when the shape differs and the elements
+   *         are borrowed or adopted
+   */
+  template <typename X, typename = std::enable_if_t<is_mat_expr_v<X>>>
+  Mat& operator=(X&& expr);
+
+  // Fused in-place forms; `other` may be a Mat, an expression or a scalar.
+  template <typename X>
+  Mat& operator+=(X&& other) {
+    return *this = *this + std::forward<X>(other);
+  }
+  template <typename X>
+  Mat& operator-=(X&& other) {
+    return *this = *this - std::forward<X>(other);
+  }
+  template <typename X>
+  Mat& operator*=(X&& other) {
+    return *this = *this * std::forward<X>(other);
+  }
 
   unsigned dimensions() const;
 
@@ -61,20 +176,64 @@ class Mat {
 
   size_type size() const;
   size_type dimension(unsigned index) const;
+  const std::vector<size_type>& shape() const { return mDimensions; }
   
+  /**
+   * Copies the matrix into one of element type T with a plain cast per
+   * element. Use convertTo() when the values may not fit in T.
+   */
   template <typename T>
   Mat<T> clone() const {
-    Mat<T> cpy(mDimensions, decltype(Mat<T>::mElements){});
-    for (unsigned i = 0; i < mSize; ++i) {
-      cpy.mElements.push_back(T(mElements[i]));
-    }
-    return cpy;
+    return convertTo<T>(1, 0, false);
+  }
+
+  /**
+   * Converts every element x to T(x * scale + offset) in a single pass.
+   *
+   * With `saturate`, results are rounded to nearest and clamped to T's range
+   * when T is integral. uint8/float/double pairs use SIMD conversions.
+   */
+  template <typename T>
+  Mat<T> convertTo(double scale = 1,
+                   double offset = 0,
+                   bool saturate = true) const {
+    auto output = Mat<T>::uninitialized(mDimensions);
+    forEachRun([&](const Element* run, size_type position, size_type count) {
+      convertElements(run, output.data() + position, count, scale, offset,
+                      saturate);
+    });
+    return output;
   }
  protected:
-  std::vector<Element> mElements;
+  struct UninitializedTag {};
+  Mat(const std::vector<size_type>& dimensions, UninitializedTag);
+  Mat(Element* data,
+      const std::vector<size_type>& dimensions,
+      const std::vector<size_type>& strides,
+      deleter_t deleter);
+
+  // Sets mDimensions, mOffsetMultipliers (dense when strides is empty),
+  // mSize and mExtent.
+  void setLayout(const std::vector<size_type>& dimensions,
+                 const std::vector<size_type>& strides);
+  bool ownsElements() const { return mData == mElements.data(); }
+  // Bounds-checked element at a raw offset, for the accessors.
+  Element& element(size_type offset);
+  const Element& element(size_type offset) const;
+
+  // Owned storage. Empty when the elements live in an external buffer.
+  storage_t mElements;
+  // First element, in mElements or in the external buffer
+  Element* mData = nullptr;
+  // Releases an adopted buffer; null for owned and borrowed elements
+  std::unique_ptr<Element, deleter_t> mExternal;
   std::vector<size_type> mDimensions;
   std::vector<unsigned> mOffsetMultipliers;
   unsigned mSize;
+  // One past the largest offset any element sits at
+  size_type mExtent;
+  // Elements are densely packed in row-major order
+  bool mContiguous = true;
 };
 
 #include "mat_accessor.hpp"
@@ -97,127 +256,296 @@ ConstMatAccessor<E> Mat<E>::operator[](unsigned index) const {
 
 template <typename Element>
 Mat<Element>::Mat(const std::vector<size_type>& dimensions)
-    : Mat(dimensions, decltype(mElements)()) {
-  this->mElements = std::vector<Element>(this->size(), 0);
+    : Mat(dimensions, UninitializedTag{}) {
+  std::fill(mData, mData + mSize, Element(0));
+}
+
+template <typename Element>
+Mat<Element>::Mat(const std::vector<size_type>& dimensions, UninitializedTag)
+    : Mat(dimensions, storage_t()) {
+  mElements.resize(mSize);
+  mData = mElements.data();
+}
+
+template <typename Element>
+Mat<Element> Mat<Element>::uninitialized(
+    const std::vector<size_type>& dimensions) {
+  return Mat(dimensions, UninitializedTag{});
 }
 
 template <typename Element>
 Mat<Element>::Mat(const std::vector<size_type>& dimensions,
                   const std::vector<Element>& elements)
-    : mElements(elements),
-      mDimensions(dimensions),
-      mOffsetMultipliers(dimensions.size()),
-      mSize(1) {
+    : Mat(dimensions, storage_t(elements.begin(), elements.end())) {}
+
+template <typename Element>
+Mat<Element>::Mat(const std::vector<size_type>& dimensions,
+                  std::initializer_list<Element> elements)
+    : Mat(dimensions, storage_t(elements)) {}
+
+template <typename Element>
+Mat<Element>::Mat(const std::vector<size_type>& dimensions, storage_t elements)
+    : mElements(std::move(elements)), mData(mElements.data()) {
+  setLayout(dimensions, {});
+}
+
+template <typename Element>
+Mat<Element>::Mat(Element* data,
+                  const std::vector<size_type>& dimensions,
+                  const std::vector<size_type>& strides,
+                  deleter_t deleter)
+    : mData(data) {
+  if (deleter) {
+    mExternal = std::unique_ptr<Element, deleter_t>(data, std::move(deleter));
+  }
+  setLayout(dimensions, strides);
+}
+
+template <typename Element>
+Mat<Element> Mat<Element>::borrow(Element* data,
+                                  const std::vector<size_type>& dimensions,
+                                  const std::vector<size_type>& strides) {
+  return Mat(data, dimensions, strides, nullptr);
+}
+
+template <typename Element>
+Mat<Element> Mat<Element>::adopt(Element* data,
+                                 const std::vector<size_type>& dimensions,
+                                 deleter_t deleter,
+                                 const std::vector<size_type>& strides) {
+  return Mat(data, dimensions, strides, std::move(deleter));
+}
+
+template <typename Element>
+void Mat<Element>::setLayout(const std::vector<size_type>& dimensions,
+                             const std::vector<size_type>& strides) {
+  if (!strides.empty() && strides.size() != dimensions.size()) {
+    throw std::invalid_argument("Mat needs one stride per dimension");
+  }
+  mDimensions = dimensions;
+  mOffsetMultipliers.assign(dimensions.size(), 1);
+  mSize = 1;
   for (unsigned sz : mDimensions) {
     mSize *= sz;
   }
-  mOffsetMultipliers.back() = 1;
-  std::inclusive_scan(mDimensions.rbegin(), mDimensions.rend() - 1,
-                      mOffsetMultipliers.rbegin() + 1, std::multiplies<int>());
+  if (strides.empty()) {
+    std::inclusive_scan(mDimensions.rbegin(), mDimensions.rend() - 1,
+                        mOffsetMultipliers.rbegin() + 1,
+                        std::multiplies<int>());
+  } else {
+    std::copy(strides.begin(), strides.end(), mOffsetMultipliers.begin());
+  }
+  mExtent = mSize > 0 ? 1 : 0;
+  for (unsigned i = 0; i < mDimensions.size() && mSize > 0; ++i) {
+    mExtent += (mDimensions[i] - 1) * size_type(mOffsetMultipliers[i]);
+  }
+  size_type dense = 1;
+  mContiguous = true;
+  for (unsigned i = mDimensions.size(); i-- > 0;) {
+    if (mDimensions[i] != 1 && mOffsetMultipliers[i] != dense) {
+      mContiguous = false;
+    }
+    dense *= mDimensions[i];
+  }
+}
+
+template <typename Element>
+Mat<Element>::Mat(const Mat& other)
+    : Mat(other.mDimensions, UninitializedTag{}) {
+  other.forEachRun([this](const Element* run, size_type position,
+                          size_type count) {
+    std::copy(run, run + count, mData + position);
+  });
+}
+
+template <typename Element>
+Mat<Element>::Mat(Mat&& other) noexcept
+    : mElements(std::move(other.mElements)),
+      mData(std::exchange(other.mData, nullptr)),
+      mExternal(std::move(other.mExternal)),
+      mDimensions(std::move(other.mDimensions)),
+      mOffsetMultipliers(std::move(other.mOffsetMultipliers)),
+      mSize(std::exchange(other.mSize, 0)),
+      mExtent(std::exchange(other.mExtent, 0)),
+      mContiguous(other.mContiguous) {}
+
+template <typename Element>
+Mat<Element>& Mat<Element>::operator=(const Mat& other) {
+  if (this != &other) {
+    *this = Mat(other);
+  }
+  return *this;
+}
+
+template <typename Element>
+Mat<Element>& Mat<Element>::operator=(Mat&& other) noexcept {
+  if (this != &other) {
+    // Moving a vector between pools with different allocators could copy
+    // its elements, so swap and let `other` release our old storage.
+    std::swap(mElements, other.mElements);
+    std::swap(mData, other.mData);
+    std::swap(mExternal, other.mExternal);
+    std::swap(mDimensions, other.mDimensions);
+    std::swap(mOffsetMultipliers, other.mOffsetMultipliers);
+    std::swap(mSize, other.mSize);
+    std::swap(mExtent, other.mExtent);
+    std::swap(mContiguous, other.mContiguous);
+  }
+  return *this;
+}
+
+template <typename Element>
+template <typename F>
+void Mat<Element>::forEachRun(F&& fn) const {
+  if (isContiguous()) {
+    fn(static_cast<const Element*>(mData), size_type(0), size_type(mSize));
+    return;
+  }
+  // Fold the densely laid out innermost dimensions into one run and walk
+  // the remaining ones like an odometer.
+  unsigned outer = mDimensions.size();
+  size_type run = 1;
+  while (outer > 0 && (mDimensions[outer - 1] == 1 ||
+                       mOffsetMultipliers[outer - 1] == run)) {
+    run *= mDimensions[--outer];
+  }
+  std::vector<size_type> index(outer, 0);
+  for (size_type position = 0; position < mSize; position += run) {
+    size_type offset = 0;
+    for (unsigned i = 0; i < outer; ++i) {
+      offset += index[i] * mOffsetMultipliers[i];
+    }
+    fn(static_cast<const Element*>(mData + offset), position, run);
+    for (unsigned i = outer; i-- > 0;) {
+      if (++index[i] < mDimensions[i]) {
+        break;
+      }
+      index[i] = 0;
+    }
+  }
+}
+
+template <typename Element>
+Element& Mat<Element>::element(size_type offset) {
+  if (offset >= mExtent) {
+    throw std::out_of_range("Mat element offset out of range");
+  }
+  return mData[offset];
+}
+
+template <typename Element>
+const Element& Mat<Element>::element(size_type offset) const {
+  if (offset >= mExtent) {
+    throw std::out_of_range("Mat element offset out of range");
+  }
+  return mData[offset];
 }
 
 template <typename Element>
 Mat<Element>::Mat(const std::vector<size_type>& dimensions,
                   const std::function<Element(unsigned)>& generator)
-    : Mat(dimensions, decltype(mElements)()) {
+    : Mat(dimensions, UninitializedTag{}) {
   for (unsigned i = 0; i < mSize; ++i) {
-    mElements.push_back(generator(i));
+    mData[i] = generator(i);
+  }
+}
+
+template <typename Element>
+template <typename X, typename>
+Mat<Element>::Mat(X&& expr)
+    : Mat(expr.shape() ? *expr.shape() : std::vector<size_type>{ 1 },
+          storage_t()) {
+  Mat* donor = nullptr;
+  if constexpr (!std::is_lvalue_reference_v<X>) {
+    donor = expr.template donor<Element>();
+  }
+  // Only owned storage is recycled; external buffers stay with their Mat.
+  if (donor && donor->mData == donor->mElements.data() && mSize > 0) {
+    evaluateMatExpr(expr, donor->data(), mSize);
+    mElements = std::move(donor->mElements);
+  } else {
+    mElements.resize(mSize);
+    evaluateMatExpr(expr, mElements.data(), mSize);
+  }
+  mData = mElements.data();
+}
+
+template <typename Element>
+template <typename X, typename>
+Mat<Element>& Mat<Element>::operator=(X&& expr) {
+  if (expr.shape() && *expr.shape() == mDimensions) {
+    if (mContiguous) {
+      evaluateMatExpr(expr, mData, mSize);
+      return *this;
+    }
+    // Runs are disjoint and cover the whole Mat, so writing through them
+    // is safe
+    forEachRun([&](const Element* run, size_type position, size_type count) {
+      Element* out = const_cast<Element*>(run);
+      for (size_type i = 0; i < count; ++i) {
+        out[i] = static_cast<Element>(expr[position + i]);
+      }
+    });
+    return *this;
+  }
+  if (!ownsElements()) {
+    throw std::invalid_argument(
+        "Assigning a differently shaped expression to a Mat over an "
+        "external buffer");
   }
+  return *this = Mat(std::forward<X>(expr));
 }
 
 template <typename Element>
 Element Mat<Element>::operator()(
     std::initializer_list<unsigned> indices) const {
   assert(indices.size() == mDimensions.size());
-  unsigned index = 0;
+  size_type index = 0;
   unsigned i = 0;
   for (const unsigned v : indices) {
-    index += mDimensions[i] * v;
+    index += mOffsetMultipliers[i] * v;
     ++i;
   }
-  return mElements[index];
+  return mData[index];
 }
 
 template <typename Element>
 Element Mat<Element>::operator()(unsigned index) const {
-  return mElements[index];
+  assert(mContiguous);
+  return mData[index];
 }
 
 template <typename Element>
 void Mat<Element>::operator()(unsigned index, const Element& value) {
-  mElements[index] = value;
+  assert(mContiguous);
+  mData[index] = value;
 }
 
 template <typename Element>
 Mat<Element>& Mat<Element>::operator=(
     const std::initializer_list<Element>& other) {
-  assert(mElements.size() == other.size());
-  unsigned i = 0;
-  for (const auto& v : other) {
-    mElements[i] = v;
-    ++i;
-  }
-  return *this;
-}
-
-template <typename Element>
-Mat<Element>& Mat<Element>::operator+=(const Mat& other) {
-  for (unsigned i = 0; i < mDimensions.size(); ++i) {
-    assert(dimension(i) == other.dimension(i));
-  }
-  for (unsigned i = 0; i < mElements.size(); ++i) {
-    mElements[i] += other.mElements[i];
-  }
+  assert(mSize == other.size() && isContiguous());
+  std::copy(other.begin(), other.end(), mData);
   return *this;
 }
 
 template <typename Element>
 Mat<Element>& Mat<Element>::operator+=(
     const std::initializer_list<Element>& other) {
-  assert(mElements.size() == other.size());
+  assert(mSize == other.size() && isContiguous());
   unsigned i = 0;
   for (const auto& v : other) {
-    mElements[i] += v;
+    mData[i] += v;
     ++i;
   }
   return *this;
 }
 
-template <typename Element>
-Mat<Element> Mat<Element>::operator+(const Mat& other) {
-  for (unsigned i = 0; i < mDimensions.size(); ++i) {
-    assert(dimension(i) == other.dimension(i));
-  }
-
-  std::vector<Element> outputElements(size());
-
-  for (unsigned i = 0; i < size(); ++i) {
-    outputElements[i] = mElements[i] + other.mElements[i];
-  }
-
-  return Mat(mDimensions, outputElements);
-}
-
 template <typename Element>
 unsigned Mat<Element>::dimensions() const {
   return mDimensions.size();
 }
 
-template <typename Element>
-Mat<Element> Mat<Element>::operator-(const Mat& other) {
-  for (unsigned i = 0; i < mDimensions.size(); ++i) {
-    assert(dimension(i) == other.dimension(i));
-  }
-
-  std::vector<Element> outputElements(size());
-
-  for (unsigned i = 0; i < size(); ++i) {
-    outputElements[i] = mElements[i] - other.mElements[i];
-  }
-
-  return Mat(mDimensions, outputElements);
-}
-
 template <typename Element>
 typename Mat<Element>::size_type Mat<Element>::size() const {
   return mSize;
@@ -65,14 +65,18 @@ const D MatAccessorBase<E, M, D>::operator[](unsigned index) const {
 template <typename E, typename M, typename D>
 MatAccessorBase<E, M, D>::operator E() const {
   assert(this->mCurrentDimension == this->mMatrix.mDimensions.size() - 1);
-  return this->mMatrix.mElements.at(this->mOffset + this->mIndex);
+  return this->mMatrix.element(
+      this->mOffset +
+      this->mIndex * this->mMatrix.mOffsetMultipliers[this->mCurrentDimension]);
 }
 
 template <typename E>
 MatAccessor<E>& MatAccessor<E>::operator=(const E& value) {
   assert(this->mCurrentDimension == this->mMatrix.mDimensions.size() - 1);
-  const auto i = this->mOffset + this->mIndex;
-  this->mMatrix.mElements.at(i) = value;
+  const auto i =
+      this->mOffset +
+      this->mIndex * this->mMatrix.mOffsetMultipliers[this->mCurrentDimension];
+  this->mMatrix.element(i) = value;
   return *this;
 }
 
@@ -0,0 +1,230 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct MatPoolStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  // Bytes currently handed out to live buffers (rounded up to size classes)
+  size_t bytesInUse = 0;
+  // Largest value bytesInUse has reached since the last resetStats()
+  size_t highWaterMark = 0;
+  // Bytes sitting in the free lists, ready to be reused
+  size_t bytesCached = 0;
+};
+
+/**
+ * Size-class pool for Mat element storage.
+ *
+ * Every block is aligned to ALIGNMENT bytes. Requests are rounded up to a
+ * size class (four classes per power of two, so at most 25% slack) and freed
+ * blocks are kept on a per-class free list instead of being returned to the
+ * heap. Filters that repeatedly allocate and drop same-sized intermediates
+ * therefore stop touching the heap once the pool has warmed up.
+ *
+ * Cached memory is bounded by capacity(); blocks freed beyond that are
+ * returned to the heap immediately.
+ */
+class MatPool {
+ public:
+  static constexpr size_t ALIGNMENT = 64;
+
+  // Intentionally leaked so that Mats with static storage duration can still
+  // be freed during program exit.
+  static MatPool& global() {
+    static MatPool* pool = new MatPool();
+    return *pool;
+  }
+
+  MatPool() = default;
+  MatPool(const MatPool&) = delete;
+  MatPool& operator=(const MatPool&) = delete;
+  ~MatPool() { release(); }
+
+  void* allocate(size_t bytes) {
+    const size_t blockSize = sizeClass(bytes);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mEnabled) {
+        auto& freeList = mFreeLists[blockSize];
+        if (!freeList.empty()) {
+          void* block = freeList.back();
+          freeList.pop_back();
+          mStats.bytesCached -= blockSize;
+          ++mStats.hits;
+          track(blockSize);
+          return block;
+        }
+      }
+      ++mStats.misses;
+      track(blockSize);
+    }
+    return ::operator new(blockSize, std::align_val_t(ALIGNMENT));
+  }
+
+  void deallocate(void* block, size_t bytes) {
+    if (!block) {
+      return;
+    }
+    const size_t blockSize = sizeClass(bytes);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStats.bytesInUse -= blockSize;
+      if (mEnabled && mStats.bytesCached + blockSize <= mCapacity) {
+        mFreeLists[blockSize].push_back(block);
+        mStats.bytesCached += blockSize;
+        return;
+      }
+    }
+    ::operator delete(block, std::align_val_t(ALIGNMENT));
+  }
+
+  // Returns every cached block to the heap.
+  void release() {
+    FreeLists cached;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      cached = takeFreeLists();
+    }
+    freeBlocks(cached);
+  }
+
+  MatPoolStats stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+  }
+
+  void resetStats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.hits = 0;
+    mStats.misses = 0;
+    mStats.highWaterMark = mStats.bytesInUse;
+  }
+
+  size_t capacity() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCapacity;
+  }
+  void setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCapacity = bytes;
+  }
+
+  // With pooling disabled every allocation goes straight to the heap, still
+  // aligned to ALIGNMENT.
+  bool enabled() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEnabled;
+  }
+  void setEnabled(bool enabled) {
+    FreeLists cached;
+    {
+      // The flag and the free lists change together, so no allocate() can
+      // pick up a block after the lists have been emptied
+      std::lock_guard<std::mutex> lock(mMutex);
+      mEnabled = enabled;
+      if (!enabled) {
+        cached = takeFreeLists();
+      }
+    }
+    freeBlocks(cached);
+  }
+
+  static size_t sizeClass(size_t bytes) {
+    if (bytes <= ALIGNMENT) {
+      return ALIGNMENT;
+    }
+    size_t power = ALIGNMENT;
+    while (power * 2 < bytes) {
+      power *= 2;
+    }
+    // Split [power, 2 * power] into quarters
+    const size_t step = std::max(power / 4, ALIGNMENT);
+    return (bytes + step - 1) / step * step;
+  }
+
+ private:
+  using FreeLists = std::unordered_map<size_t, std::vector<void*>>;
+
+  // Detaches the free lists; the caller holds mMutex.
+  FreeLists takeFreeLists() {
+    mStats.bytesCached = 0;
+    return std::exchange(mFreeLists, FreeLists());
+  }
+
+  static void freeBlocks(const FreeLists& freeLists) {
+    for (const auto& [blockSize, freeList] : freeLists) {
+      for (void* block : freeList) {
+        ::operator delete(block, std::align_val_t(ALIGNMENT));
+      }
+    }
+  }
+
+  void track(size_t blockSize) {
+    mStats.bytesInUse += blockSize;
+    mStats.highWaterMark = std::max(mStats.highWaterMark, mStats.bytesInUse);
+  }
+
+  mutable std::mutex mMutex;
+  FreeLists mFreeLists;
+  MatPoolStats mStats;
+  size_t mCapacity = size_t(512) << 20;
+  bool mEnabled = true;
+};
+
+/**
+ * Standard allocator that serves element storage from a MatPool, so any
+ * std::vector can share the pool Mat uses. Defaults to MatPool::global().
+ */
+template <typename T>
+class MatAllocator {
+ public:
+  using value_type = T;
+
+  MatAllocator() noexcept : mPool(&MatPool::global()) {}
+  explicit MatAllocator(MatPool& pool) noexcept : mPool(&pool) {}
+
+  template <typename U>
+  MatAllocator(const MatAllocator<U>& other) noexcept : mPool(other.pool()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(mPool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    mPool->deallocate(p, n * sizeof(T));
+  }
+
+  // Default-initializes rather than value-initializes, so resizing storage of
+  // arithmetic types leaves it uninitialized instead of zero-filling it.
+  template <typename U>
+  void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void*>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  MatPool* pool() const noexcept { return mPool; }
+
+  template <typename U>
+  bool operator==(const MatAllocator<U>& other) const noexcept {
+    return mPool == other.pool();
+  }
+
+  template <typename U>
+  bool operator!=(const MatAllocator<U>& other) const noexcept {
+    return mPool != other.pool();
+  }
+
+ private:
+  MatPool* mPool;
+};
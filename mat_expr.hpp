@@ -0,0 +1,283 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Lazy element-wise arithmetic on Mats.
+ *
+ * `a + b * 2 - c` builds a tree of expression objects instead of full-size
+ * temporaries. Nothing is computed until the expression is assigned to a Mat,
+ * at which point every element is evaluated once in a single loop that the
+ * compiler can vectorize. Leaves hold lvalue Mats by reference and take
+ * ownership of rvalue Mats; the storage of an owned operand of the right
+ * element type is reused for the result.
+ *
+ * Leaves over strided Mats read a dense copy, so an expression may mix
+ * views with any strides; assigning it writes through the target's strides.
+ *
+ * Expressions referencing lvalue Mats must not outlive them, so prefer
+ * assigning to a Mat over storing an expression in an `auto` variable.
+ */
+
+template <typename Element>
+class Mat;
+
+struct MatExprTag {};
+
+template <typename T>
+constexpr bool is_mat_expr_v =
+    std::is_base_of_v<MatExprTag, std::remove_cv_t<std::remove_reference_t<T>>>;
+
+template <typename T>
+struct is_mat : std::false_type {};
+template <typename E>
+struct is_mat<Mat<E>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_mat_v =
+    is_mat<std::remove_cv_t<std::remove_reference_t<T>>>::value;
+
+template <typename T>
+constexpr bool is_mat_operand_v = is_mat_v<T> || is_mat_expr_v<T>;
+
+using mat_shape_t = std::vector<size_t>;
+
+template <typename E>
+class MatRefExpr : public MatExprTag {
+ public:
+  using value_type = E;
+
+  explicit MatRefExpr(const Mat<E>& mat)
+      : mData(mat.data()), mSize(mat.size()), mShape(&mat.shape()) {
+    if (!mat.isContiguous()) {
+      // Read a dense snapshot, shared between copies of the expression
+      mCompact = std::make_shared<const Mat<E>>(mat);
+      mData = mCompact->data();
+    }
+  }
+
+  E operator[](size_t i) const { return mData[i]; }
+  size_t size() const { return mSize; }
+  const mat_shape_t* shape() const { return mShape; }
+
+  template <typename T>
+  Mat<T>* donor() {
+    return nullptr;
+  }
+
+ private:
+  const E* mData;
+  size_t mSize;
+  const mat_shape_t* mShape;
+  std::shared_ptr<const Mat<E>> mCompact;
+};
+
+template <typename E>
+class MatOwnedExpr : public MatExprTag {
+ public:
+  using value_type = E;
+
+  // Strided Mats are compacted, which also leaves their buffer alone
+  explicit MatOwnedExpr(Mat<E>&& mat)
+      : mMat(mat.isContiguous() ? std::move(mat) : Mat<E>(mat)) {}
+
+  E operator[](size_t i) const { return mMat.data()[i]; }
+  size_t size() const { return mMat.size(); }
+  const mat_shape_t* shape() const { return &mMat.shape(); }
+
+  template <typename T>
+  Mat<T>* donor() {
+    if constexpr (std::is_same_v<T, E>) {
+      return &mMat;
+    } else {
+      return nullptr;
+    }
+  }
+
+ private:
+  Mat<E> mMat;
+};
+
+template <typename S>
+class MatScalarExpr : public MatExprTag {
+ public:
+  using value_type = S;
+
+  explicit MatScalarExpr(S value) : mValue(value) {}
+
+  S operator[](size_t) const { return mValue; }
+  size_t size() const { return 0; }
+  const mat_shape_t* shape() const { return nullptr; }
+
+  template <typename T>
+  Mat<T>* donor() {
+    return nullptr;
+  }
+
+ private:
+  S mValue;
+};
+
+template <typename Op, typename A>
+class MatUnaryExpr : public MatExprTag {
+ public:
+  using value_type =
+      decltype(std::declval<Op>()(std::declval<typename A::value_type>()));
+
+  explicit MatUnaryExpr(A a) : mA(std::move(a)) {}
+
+  value_type operator[](size_t i) const { return Op()(mA[i]); }
+  size_t size() const { return mA.size(); }
+  const mat_shape_t* shape() const { return mA.shape(); }
+
+  template <typename T>
+  Mat<T>* donor() {
+    return mA.template donor<T>();
+  }
+
+ private:
+  A mA;
+};
+
+template <typename Op, typename L, typename R>
+class MatBinaryExpr : public MatExprTag {
+ public:
+  using value_type =
+      decltype(std::declval<Op>()(std::declval<typename L::value_type>(),
+                                  std::declval<typename R::value_type>()));
+
+  MatBinaryExpr(L l, R r) : mL(std::move(l)), mR(std::move(r)) {
+    assert(!mL.shape() || !mR.shape() || *mL.shape() == *mR.shape());
+  }
+
+  value_type operator[](size_t i) const { return Op()(mL[i], mR[i]); }
+  size_t size() const { return mL.shape() ? mL.size() : mR.size(); }
+  const mat_shape_t* shape() const {
+    return mL.shape() ? mL.shape() : mR.shape();
+  }
+
+  template <typename T>
+  Mat<T>* donor() {
+    if (auto* mat = mL.template donor<T>()) {
+      return mat;
+    }
+    return mR.template donor<T>();
+  }
+
+ private:
+  L mL;
+  R mR;
+};
+
+/**
+ * Wraps an operand as an expression node: lvalue Mats by reference, rvalue
+ * Mats by value, scalars as broadcast constants, expressions as themselves.
+ */
+template <typename X>
+auto toMatExpr(X&& x) {
+  using D = std::remove_cv_t<std::remove_reference_t<X>>;
+  if constexpr (is_mat_expr_v<D>) {
+    return D(std::forward<X>(x));
+  } else if constexpr (is_mat_v<D> && std::is_lvalue_reference_v<X>) {
+    return MatRefExpr<typename D::value_type>(x);
+  } else if constexpr (is_mat_v<D>) {
+    return MatOwnedExpr<typename D::value_type>(std::move(x));
+  } else {
+    return MatScalarExpr<D>(x);
+  }
+}
+
+template <typename Op, typename L, typename R>
+auto makeMatBinaryExpr(L&& l, R&& r) {
+  using LE = decltype(toMatExpr(std::forward<L>(l)));
+  using RE = decltype(toMatExpr(std::forward<R>(r)));
+  return MatBinaryExpr<Op, LE, RE>(toMatExpr(std::forward<L>(l)),
+                                   toMatExpr(std::forward<R>(r)));
+}
+
+// Binary operators apply when at least one side is a Mat or an expression
+// and the other is a Mat, an expression or an arithmetic scalar.
+template <typename L, typename R>
+constexpr bool mat_binary_operands_v =
+    (is_mat_operand_v<L> &&
+     (is_mat_operand_v<R> || std::is_arithmetic_v<std::decay_t<R>>)) ||
+    (is_mat_operand_v<R> && std::is_arithmetic_v<std::decay_t<L>>);
+
+struct MatMinOp {
+  template <typename A, typename B>
+  auto operator()(A a, B b) const {
+    using C = std::common_type_t<A, B>;
+    return C(b) < C(a) ? C(b) : C(a);
+  }
+};
+
+struct MatMaxOp {
+  template <typename A, typename B>
+  auto operator()(A a, B b) const {
+    using C = std::common_type_t<A, B>;
+    return C(a) < C(b) ? C(b) : C(a);
+  }
+};
+
+struct MatAbsOp {
+  template <typename A>
+  auto operator()(A a) const {
+    if constexpr (std::is_unsigned_v<A>) {
+      return a;
+    } else {
+      return a < 0 ? -a : a;
+    }
+  }
+};
+
+#define MAT_EXPR_BINARY_OPERATOR(OPERATOR, FUNCTOR)                   \
+  template <typename L, typename R,                                   \
+            typename = std::enable_if_t<mat_binary_operands_v<L, R>>> \
+  auto OPERATOR(L&& l, R&& r) {                                       \
+    return makeMatBinaryExpr<FUNCTOR>(std::forward<L>(l),             \
+                                      std::forward<R>(r));            \
+  }
+
+MAT_EXPR_BINARY_OPERATOR(operator+, std::plus<>)
+MAT_EXPR_BINARY_OPERATOR(operator-, std::minus<>)
+MAT_EXPR_BINARY_OPERATOR(operator*, std::multiplies<>)
+MAT_EXPR_BINARY_OPERATOR(operator/, std::divides<>)
+// Comparisons yield bool elements, which become 0 or 1 when assigned.
+MAT_EXPR_BINARY_OPERATOR(operator<, std::less<>)
+MAT_EXPR_BINARY_OPERATOR(operator<=, std::less_equal<>)
+MAT_EXPR_BINARY_OPERATOR(operator>, std::greater<>)
+MAT_EXPR_BINARY_OPERATOR(operator>=, std::greater_equal<>)
+MAT_EXPR_BINARY_OPERATOR(operator==, std::equal_to<>)
+MAT_EXPR_BINARY_OPERATOR(operator!=, std::not_equal_to<>)
+MAT_EXPR_BINARY_OPERATOR(min, MatMinOp)
+MAT_EXPR_BINARY_OPERATOR(max, MatMaxOp)
+
+#undef MAT_EXPR_BINARY_OPERATOR
+
+template <typename A, typename = std::enable_if_t<is_mat_operand_v<A>>>
+auto abs(A&& a) {
+  using AE = decltype(toMatExpr(std::forward<A>(a)));
+  return MatUnaryExpr<MatAbsOp, AE>(toMatExpr(std::forward<A>(a)));
+}
+
+template <typename A, typename = std::enable_if_t<is_mat_operand_v<A>>>
+auto operator-(A&& a) {
+  using AE = decltype(toMatExpr(std::forward<A>(a)));
+  return MatUnaryExpr<std::negate<>, AE>(toMatExpr(std::forward<A>(a)));
+}
+
+/**
+ * Evaluates every element of expr into out[0, n). out may alias any operand:
+ * each element is read before the same index is written.
+ */
+template <typename T, typename X>
+void evaluateMatExpr(const X& expr, T* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<T>(expr[i]);
+  }
+}
@@ -27,20 +27,6 @@ void makeMat(const BoxFilter& filter) {
   }
 }
 
-template <typename T, typename O>
-void normalize2(Mat<T>& mat, O range_beg, O range_end) {
-  O min_val = *std::min_element(mat.begin(), mat.end());
-  O max_val = *std::max_element(mat.begin(), mat.end());
-
-  std::transform(mat.begin(), mat.end(), mat.begin(),
-                 [min_val, max_val, range_beg, range_end](T n) -> double {
-                   double d = (range_end - range_beg) / (max_val - min_val) *
-                                  (n - max_val) +
-                              range_end;
-                   return d;
-                 });
-}
-
 template <typename V>
 Mat<double> convolute(Mat<V>& input, const BoxFilter& boxFilter) {
   const auto WIDTH = img::width(input);
@@ -65,7 +51,7 @@ Mat<double> convolute(Mat<V>& input, const BoxFilter& boxFilter) {
       }
     }
   }
-  normalize2<double, double>(output, 0, 255);
+  normalize<double>(output, 0, 255);
   return output;
 }
 
@@ -93,7 +79,7 @@ Mat<double> convolute2(Mat<V>& input, const BoxFilter& boxFilter) {
       }
     }
   }
-  normalize2<double, double>(output, 0, 255);
+  normalize<double>(output, 0, 255);
   return output;
 }
 
@@ -121,7 +107,7 @@ Mat<double> convolute3(Mat<V>& input, const BoxFilter& boxFilter) {
       }
     }
   }
-  normalize2<double, double>(output, 0, 255);
+  normalize<double>(output, 0, 255);
   return output;
 }
 int main(int argc, char** argv) {
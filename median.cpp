@@ -0,0 +1,304 @@
+#include "median.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Window counts must fit the 16-bit histogram bins: 255^2 < 65536.
+constexpr unsigned MAX_RADIUS = 127;
+
+inline void sort2(uint8_t& a, uint8_t& b) {
+  const uint8_t lo = std::min(a, b);
+  b = std::max(a, b);
+  a = lo;
+}
+
+#ifdef __SSE2__
+inline void sort2(__m128i& a, __m128i& b) {
+  const __m128i lo = _mm_min_epu8(a, b);
+  b = _mm_max_epu8(a, b);
+  a = lo;
+}
+#endif
+
+// Median-of-9 and median-of-25 exchange networks (Paeth; Devillard). They
+// only order as much as the middle element needs.
+template <typename V>
+V median9(V* p) {
+  sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+  sort2(p[0], p[1]); sort2(p[3], p[4]); sort2(p[6], p[7]);
+  sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+  sort2(p[0], p[3]); sort2(p[5], p[8]); sort2(p[4], p[7]);
+  sort2(p[3], p[6]); sort2(p[1], p[4]); sort2(p[2], p[5]);
+  sort2(p[4], p[7]); sort2(p[4], p[2]); sort2(p[6], p[4]);
+  sort2(p[4], p[2]);
+  return p[4];
+}
+
+template <typename V>
+V median25(V* p) {
+  sort2(p[0], p[1]);   sort2(p[3], p[4]);   sort2(p[2], p[4]);
+  sort2(p[2], p[3]);   sort2(p[6], p[7]);   sort2(p[5], p[7]);
+  sort2(p[5], p[6]);   sort2(p[9], p[10]);  sort2(p[8], p[10]);
+  sort2(p[8], p[9]);   sort2(p[12], p[13]); sort2(p[11], p[13]);
+  sort2(p[11], p[12]); sort2(p[15], p[16]); sort2(p[14], p[16]);
+  sort2(p[14], p[15]); sort2(p[18], p[19]); sort2(p[17], p[19]);
+  sort2(p[17], p[18]); sort2(p[21], p[22]); sort2(p[20], p[22]);
+  sort2(p[20], p[21]); sort2(p[23], p[24]); sort2(p[2], p[5]);
+  sort2(p[3], p[6]);   sort2(p[0], p[6]);   sort2(p[0], p[3]);
+  sort2(p[4], p[7]);   sort2(p[1], p[7]);   sort2(p[1], p[4]);
+  sort2(p[11], p[14]); sort2(p[8], p[14]);  sort2(p[8], p[11]);
+  sort2(p[12], p[15]); sort2(p[9], p[15]);  sort2(p[9], p[12]);
+  sort2(p[13], p[16]); sort2(p[10], p[16]); sort2(p[10], p[13]);
+  sort2(p[20], p[23]); sort2(p[17], p[23]); sort2(p[17], p[20]);
+  sort2(p[21], p[24]); sort2(p[18], p[24]); sort2(p[18], p[21]);
+  sort2(p[19], p[22]); sort2(p[8], p[17]);  sort2(p[9], p[18]);
+  sort2(p[0], p[18]);  sort2(p[0], p[9]);   sort2(p[10], p[19]);
+  sort2(p[1], p[19]);  sort2(p[1], p[10]);  sort2(p[11], p[20]);
+  sort2(p[2], p[20]);  sort2(p[2], p[11]);  sort2(p[12], p[21]);
+  sort2(p[3], p[21]);  sort2(p[3], p[12]);  sort2(p[13], p[22]);
+  sort2(p[4], p[22]);  sort2(p[4], p[13]);  sort2(p[14], p[23]);
+  sort2(p[5], p[23]);  sort2(p[5], p[14]);  sort2(p[15], p[24]);
+  sort2(p[6], p[24]);  sort2(p[6], p[15]);  sort2(p[7], p[16]);
+  sort2(p[7], p[19]);  sort2(p[13], p[21]); sort2(p[15], p[23]);
+  sort2(p[7], p[13]);  sort2(p[7], p[15]);  sort2(p[1], p[9]);
+  sort2(p[3], p[11]);  sort2(p[5], p[17]);  sort2(p[11], p[17]);
+  sort2(p[9], p[17]);  sort2(p[4], p[10]);  sort2(p[6], p[12]);
+  sort2(p[7], p[14]);  sort2(p[4], p[6]);   sort2(p[4], p[7]);
+  sort2(p[12], p[14]); sort2(p[10], p[14]); sort2(p[6], p[7]);
+  sort2(p[10], p[12]); sort2(p[6], p[10]);  sort2(p[6], p[17]);
+  sort2(p[12], p[17]); sort2(p[7], p[17]);  sort2(p[7], p[10]);
+  sort2(p[12], p[18]); sort2(p[7], p[12]);  sort2(p[10], p[18]);
+  sort2(p[12], p[20]); sort2(p[10], p[20]); sort2(p[10], p[12]);
+  return p[12];
+}
+
+template <unsigned RADIUS, typename V>
+V medianOf(V* p) {
+  if constexpr (RADIUS == 1) {
+    return median9(p);
+  } else {
+    return median25(p);
+  }
+}
+
+// Copy of the image with RADIUS mirrored pixels on the left and right of
+// every row, so the network loops read neighbours without bounds checks.
+Mat<uint8_t> padColumns(const Mat<uint8_t>& image, unsigned radius) {
+  const unsigned height = img::height(image);
+  const unsigned width = img::width(image);
+  const unsigned channels = img::channel(image);
+  auto padded = Mat<uint8_t>::uninitialized(
+      { height, width + 2 * radius, channels });
+  const size_t paddedRow = size_t(width + 2 * radius) * channels;
+  for (unsigned y = 0; y < height; ++y) {
+    uint8_t* out = padded.data() + y * paddedRow;
+    const uint8_t* in = image.data() + y * image.stride(0);
+    for (int x = -int(radius); x < int(width + radius); ++x) {
+      std::memcpy(out, in + mirror(x, width) * channels, channels);
+      out += channels;
+    }
+  }
+  return padded;
+}
+
+// Sorting-network median for radius 1 and 2. Interleaved channels are
+// independent lanes: the horizontal neighbours of an element are whole
+// pixels, i.e. `channels` bytes, away.
+template <unsigned RADIUS>
+Mat<uint8_t> networkMedian(const Mat<uint8_t>& image) {
+  constexpr unsigned SIDE = 2 * RADIUS + 1;
+  const unsigned height = img::height(image);
+  const unsigned width = img::width(image);
+  const unsigned channels = img::channel(image);
+  const size_t rowLength = size_t(width) * channels;
+  const size_t paddedRow = size_t(width + 2 * RADIUS) * channels;
+  const auto padded = padColumns(image, RADIUS);
+  auto output = Mat<uint8_t>::uninitialized({ height, width, channels });
+
+  parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / rowLength),
+      [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+          const uint8_t* rows[SIDE];
+          for (unsigned k = 0; k < SIDE; ++k) {
+            rows[k] = padded.data() +
+                      mirror(int(y + k) - RADIUS, height) * paddedRow;
+          }
+          uint8_t* out = output.data() + y * rowLength;
+          size_t i = 0;
+#ifdef __SSE2__
+          for (; i + 16 <= rowLength; i += 16) {
+            __m128i window[SIDE * SIDE];
+            for (unsigned k = 0; k < SIDE; ++k) {
+              for (unsigned dx = 0; dx < SIDE; ++dx) {
+                window[k * SIDE + dx] = _mm_loadu_si128(
+                    (const __m128i*)(rows[k] + i + dx * channels));
+              }
+            }
+            _mm_storeu_si128((__m128i*)(out + i),
+                             medianOf<RADIUS>(window));
+          }
+#endif
+          for (; i < rowLength; ++i) {
+            uint8_t window[SIDE * SIDE];
+            for (unsigned k = 0; k < SIDE; ++k) {
+              for (unsigned dx = 0; dx < SIDE; ++dx) {
+                window[k * SIDE + dx] = rows[k][i + dx * channels];
+              }
+            }
+            out[i] = medianOf<RADIUS>(window);
+          }
+        }
+      });
+  return output;
+}
+
+/**
+ * Two-level histogram: 256 fine bins and 16 coarse bins of 16 values each.
+ * The coarse level lets the median search skip to the right 16 fine bins.
+ */
+struct alignas(64) Histogram {
+  uint16_t fine[256];
+  uint16_t coarse[16];
+
+  void clear() {
+    std::fill(std::begin(fine), std::end(fine), 0);
+    std::fill(std::begin(coarse), std::end(coarse), 0);
+  }
+  void add(uint8_t value) {
+    ++fine[value];
+    ++coarse[value >> 4];
+  }
+  void remove(uint8_t value) {
+    --fine[value];
+    --coarse[value >> 4];
+  }
+  // Fixed-length loops over 16-bit bins, which the compiler vectorizes
+  void add(const Histogram& other) {
+    for (unsigned i = 0; i < 256; ++i) {
+      fine[i] += other.fine[i];
+    }
+    for (unsigned i = 0; i < 16; ++i) {
+      coarse[i] += other.coarse[i];
+    }
+  }
+  void slide(const Histogram& in, const Histogram& out) {
+    for (unsigned i = 0; i < 256; ++i) {
+      fine[i] += in.fine[i] - out.fine[i];
+    }
+    for (unsigned i = 0; i < 16; ++i) {
+      coarse[i] += in.coarse[i] - out.coarse[i];
+    }
+  }
+  // Value with `rank` smaller values in the histogram
+  uint8_t select(unsigned rank) const {
+    unsigned bucket = 0;
+    while (rank >= coarse[bucket]) {
+      rank -= coarse[bucket++];
+    }
+    unsigned value = bucket * 16;
+    while (rank >= fine[value]) {
+      rank -= fine[value++];
+    }
+    return uint8_t(value);
+  }
+};
+
+Mat<uint8_t> histogramMedian(const Mat<uint8_t>& image, unsigned radius) {
+  const unsigned height = img::height(image);
+  const unsigned width = img::width(image);
+  const unsigned channels = img::channel(image);
+  const size_t rowLength = size_t(width) * channels;
+  const size_t pitch = image.stride(0);
+  const unsigned side = 2 * radius + 1;
+  const unsigned rank = side * side / 2;
+  auto output = Mat<uint8_t>::uninitialized({ height, width, channels });
+
+  // Each strip builds its own column histograms from scratch, which costs
+  // `side` rows, so strips are kept several windows tall.
+  parallelFor(
+      height, std::max(4u * side, 32u),
+      [&](size_t begin, size_t end, unsigned) {
+        std::vector<Histogram> columns(rowLength);
+        Histogram window;
+        for (auto& column : columns) {
+          column.clear();
+        }
+        for (int dy = -int(radius); dy <= int(radius); ++dy) {
+          const uint8_t* row =
+              image.data() + mirror(int(begin) + dy, height) * pitch;
+          for (size_t i = 0; i < rowLength; ++i) {
+            columns[i].add(row[i]);
+          }
+        }
+
+        for (size_t y = begin; y < end; ++y) {
+          if (y > begin) {
+            const uint8_t* leaving =
+                image.data() + mirror(int(y) - int(radius) - 1, height) * pitch;
+            const uint8_t* entering =
+                image.data() + mirror(int(y + radius), height) * pitch;
+            for (size_t i = 0; i < rowLength; ++i) {
+              columns[i].remove(leaving[i]);
+              columns[i].add(entering[i]);
+            }
+          }
+
+          uint8_t* out = output.data() + y * rowLength;
+          for (unsigned c = 0; c < channels; ++c) {
+            window.clear();
+            for (int dx = -int(radius); dx <= int(radius); ++dx) {
+              window.add(columns[mirror(dx, width) * channels + c]);
+            }
+            for (unsigned x = 0; x < width; ++x) {
+              out[x * channels + c] = window.select(rank);
+              if (x + 1 < width) {
+                const int in = mirror(int(x + 1 + radius), width);
+                const int gone = mirror(int(x) - int(radius), width);
+                window.slide(columns[in * channels + c],
+                             columns[gone * channels + c]);
+              }
+            }
+          }
+        }
+      });
+  return output;
+}
+
+}  // namespace
+
+Mat<uint8_t> median(const Mat<uint8_t>& image, unsigned radius) {
+  const unsigned height = img::height(image);
+  const unsigned width = img::width(image);
+  if (radius > MAX_RADIUS || radius >= std::min(height, width)) {
+    throw std::invalid_argument("median: radius " + std::to_string(radius) +
+                                " is too large for a " +
+                                std::to_string(height) + "x" +
+                                std::to_string(width) + " image");
+  }
+  if (image.stride(2) != 1 || image.stride(1) != img::channel(image)) {
+    return median(Mat<uint8_t>(image), radius);
+  }
+  switch (radius) {
+    case 0:
+      return Mat<uint8_t>(image);
+    case 1:
+      return networkMedian<1>(image);
+    case 2:
+      return networkMedian<2>(image);
+    default:
+      return histogramMedian(image, radius);
+  }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+#include "mat.hpp"
+
+/**
+ * Median filter over a (2 * radius + 1)^2 square, per channel. Borders are
+ * mirrored like in convolute().
+ *
+ * Radius 1 and 2 run vectorized sorting networks over 16 elements at a
+ * time. Larger radii use the Perreault-Hebert constant-time method: one
+ * 256-bin histogram per column is updated by a single pixel per row, and
+ * the window histogram slides along each row by adding one column histogram
+ * and subtracting another, so the cost per pixel does not depend on the
+ * radius.
+ *
+ * @throws std::invalid_argument if radius exceeds 127 or is not smaller
+ *         than both image sides
+ */
+Mat<uint8_t> median(const Mat<uint8_t>& image, unsigned radius);
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+#include "mat.hpp"
+
+/**
+ * Rectangular structuring element, height x width pixels. Lines are
+ * rectangles one pixel thick.
+ */
+struct StructuringElement {
+  unsigned height, width;
+
+  static StructuringElement rect(unsigned height, unsigned width) {
+    return { height, width };
+  }
+  static StructuringElement horizontal(unsigned length) { return { 1, length }; }
+  static StructuringElement vertical(unsigned length) { return { length, 1 }; }
+};
+
+/**
+ * Grayscale morphology over a rectangle, per channel; on 0/255 edge maps
+ * from canny() these are the binary operations. Pixels outside the image
+ * never win: they count as 0 for dilation and 255 for erosion.
+ *
+ * Erosion takes the minimum over rows [y - (height - 1) / 2, y + height / 2]
+ * and the matching columns. Dilation uses the reflected element, so opening()
+ * and closing() are idempotent for even sizes too.
+ *
+ * The rectangle is separated into a row pass and a column pass, each using
+ * the van Herk/Gil-Werman running extremum: three comparisons per pixel
+ * whatever the size. Column passes run along whole rows, so they vectorize
+ * without transposing; short row windows take vectorized shifted maxima
+ * instead.
+ *
+ * @throws std::invalid_argument for an element with a zero side
+ */
+Mat<uint8_t> dilate(const Mat<uint8_t>& image, StructuringElement element);
+Mat<uint8_t> erode(const Mat<uint8_t>& image, StructuringElement element);
+
+// Named opening() and closing() so they do not overload the POSIX open()
+// and close().
+
+// Erosion then dilation: removes specks smaller than the element.
+Mat<uint8_t> opening(const Mat<uint8_t>& image, StructuringElement element);
+// Dilation then erosion: fills gaps smaller than the element.
+Mat<uint8_t> closing(const Mat<uint8_t>& image, StructuringElement element);
@@ -0,0 +1,205 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "mat.hpp"
+#include "parallel.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Vectorized body of minMax() for the element types our filters produce.
+ * Each specialization folds a multiple of its vector width into lo/hi and
+ * returns how many elements it consumed.
+ */
+template <typename T>
+struct SimdMinMax {
+  static size_t run(const T*, size_t, T&, T&) { return 0; }
+};
+
+#ifdef __SSE2__
+template <>
+struct SimdMinMax<double> {
+  static size_t run(const double* data, size_t n, double& lo, double& hi) {
+    if (n < 4) {
+      return 0;
+    }
+    __m128d min0 = _mm_loadu_pd(data), max0 = min0;
+    __m128d min1 = _mm_loadu_pd(data + 2), max1 = min1;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      const __m128d a = _mm_loadu_pd(data + i);
+      const __m128d b = _mm_loadu_pd(data + i + 2);
+      min0 = _mm_min_pd(min0, a);
+      max0 = _mm_max_pd(max0, a);
+      min1 = _mm_min_pd(min1, b);
+      max1 = _mm_max_pd(max1, b);
+    }
+    double mins[4], maxs[4];
+    _mm_storeu_pd(mins, _mm_min_pd(min0, min1));
+    _mm_storeu_pd(maxs, _mm_max_pd(max0, max1));
+    lo = std::min({ lo, mins[0], mins[1] });
+    hi = std::max({ hi, maxs[0], maxs[1] });
+    return i;
+  }
+};
+
+template <>
+struct SimdMinMax<float> {
+  static size_t run(const float* data, size_t n, float& lo, float& hi) {
+    if (n < 4) {
+      return 0;
+    }
+    __m128 mins = _mm_loadu_ps(data), maxs = mins;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+      const __m128 a = _mm_loadu_ps(data + i);
+      mins = _mm_min_ps(mins, a);
+      maxs = _mm_max_ps(maxs, a);
+    }
+    float minLanes[4], maxLanes[4];
+    _mm_storeu_ps(minLanes, mins);
+    _mm_storeu_ps(maxLanes, maxs);
+    for (int k = 0; k < 4; ++k) {
+      lo = std::min(lo, minLanes[k]);
+      hi = std::max(hi, maxLanes[k]);
+    }
+    return i;
+  }
+};
+
+template <>
+struct SimdMinMax<uint8_t> {
+  static size_t run(const uint8_t* data, size_t n, uint8_t& lo, uint8_t& hi) {
+    if (n < 16) {
+      return 0;
+    }
+    __m128i mins = _mm_loadu_si128((const __m128i*)data), maxs = mins;
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+      const __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+      mins = _mm_min_epu8(mins, a);
+      maxs = _mm_max_epu8(maxs, a);
+    }
+    uint8_t minLanes[16], maxLanes[16];
+    _mm_storeu_si128((__m128i*)minLanes, mins);
+    _mm_storeu_si128((__m128i*)maxLanes, maxs);
+    for (int k = 0; k < 16; ++k) {
+      lo = std::min(lo, minLanes[k]);
+      hi = std::max(hi, maxLanes[k]);
+    }
+    return i;
+  }
+};
+#endif
+
+/**
+ * Finds the smallest and largest of n elements in a single pass.
+ *
+ * @param parallel Split the reduction across threads. Only worth it on
+ *                 full-size frames.
+ */
+template <typename T>
+std::pair<T, T> minMax(const T* data, size_t n, bool parallel = false) {
+  if (n == 0) {
+    return { T(), T() };
+  }
+  const auto reduce = [data](size_t begin, size_t end, T& lo, T& hi) {
+    size_t i = begin + SimdMinMax<T>::run(data + begin, end - begin, lo, hi);
+    for (; i < end; ++i) {
+      lo = std::min(lo, data[i]);
+      hi = std::max(hi, data[i]);
+    }
+  };
+
+  if (!parallel) {
+    T lo = data[0], hi = data[0];
+    reduce(0, n, lo, hi);
+    return { lo, hi };
+  }
+
+  std::vector<std::pair<T, T>> partials(maxChunks(), { data[0], data[0] });
+  const unsigned chunks =
+      parallelFor(n, 1 << 16, [&](size_t begin, size_t end, unsigned chunk) {
+        reduce(begin, end, partials[chunk].first, partials[chunk].second);
+      });
+  auto result = partials[0];
+  for (unsigned chunk = 1; chunk < chunks; ++chunk) {
+    result.first = std::min(result.first, partials[chunk].first);
+    result.second = std::max(result.second, partials[chunk].second);
+  }
+  return result;
+}
+
+// Extrema of a Mat's elements; strided Mats are reduced run by run.
+template <typename T>
+std::pair<T, T> minMax(const Mat<T>& mat, bool parallel = false) {
+  if (mat.isContiguous()) {
+    return minMax(mat.data(), mat.size(), parallel);
+  }
+  std::pair<T, T> result{};
+  mat.forEachRun([&](const T* run, size_t position, size_t count) {
+    const auto [lo, hi] = minMax(run, count, parallel);
+    result = position == 0 ? std::pair<T, T>(lo, hi)
+                           : std::pair<T, T>(std::min(result.first, lo),
+                                             std::max(result.second, hi));
+  });
+  return result;
+}
+
+// Affine map x * scale + offset, in the form convertTo() takes it.
+struct LinearMap {
+  double scale;
+  double offset;
+};
+
+/**
+ * Builds the map taking [min, max] onto [range_beg, range_end]. A constant
+ * input (min == max) maps everything to range_beg.
+ */
+inline LinearMap linearRemap(double min,
+                             double max,
+                             double range_beg,
+                             double range_end) {
+  const double range = max - min;
+  const double scale = range > 0 ? (range_end - range_beg) / range : 0;
+  return { scale, range_beg - min * scale };
+}
+
+/**
+ * Linearly rescales mat in place so its values span [range_beg, range_end]:
+ * one reduction pass for the extrema, one pass to apply the map.
+ */
+template <typename T>
+void normalize(Mat<T>& mat, T range_beg, T range_end, bool parallel = false) {
+  const auto [min_val, max_val] = minMax(mat, parallel);
+  const auto map = linearRemap(min_val, max_val, range_beg, range_end);
+  // Runs are disjoint, so each one is remapped in place
+  mat.forEachRun([&](const T* run, size_t, size_t count) {
+    T* elements = const_cast<T*>(run);
+    convertElements(elements, elements, count, map.scale, map.offset);
+  });
+}
+
+/**
+ * Converts mat to element type T while linearly mapping [min(mat), max(mat)]
+ * onto [range_beg, range_end]. The remap is fused into the conversion pass,
+ * and the result saturates to T's range.
+ *
+ * When the producer already knows the range of its output, call
+ * convertTo() with linearRemap() directly and skip the reduction.
+ */
+template <typename T, typename S>
+Mat<T> normalizeTo(const Mat<S>& mat,
+                   double range_beg,
+                   double range_end,
+                   bool parallel = false) {
+  const auto [min_val, max_val] = minMax(mat, parallel);
+  const auto map = linearRemap(min_val, max_val, range_beg, range_end);
+  return mat.template convertTo<T>(map.scale, map.offset);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * Number of worker threads parallelFor uses at most, including the calling
+ * thread.
+ */
+inline unsigned threadCount() {
+  static const unsigned count =
+      std::max(1u, std::thread::hardware_concurrency());
+  return count;
+}
+
+/**
+ * Splits [0, count) into contiguous chunks and calls fn(begin, end, chunk)
+ * for each on its own thread, the first chunk running on the calling thread.
+ * Work smaller than `grain` items per thread is not split further, so small
+ * inputs run inline without spawning anything.
+ *
+ * @returns The number of chunks used, so per-chunk partial results can be
+ *          sized with maxChunks() beforehand and merged afterwards.
+ */
+template <typename Fn>
+unsigned parallelFor(size_t count, size_t grain, Fn&& fn) {
+  const size_t byGrain = grain ? (count + grain - 1) / grain : count;
+  const unsigned chunks =
+      unsigned(std::max<size_t>(1, std::min<size_t>(threadCount(), byGrain)));
+  if (chunks == 1) {
+    fn(size_t(0), count, 0u);
+    return 1;
+  }
+
+  const size_t step = (count + chunks - 1) / chunks;
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (unsigned chunk = 1; chunk < chunks; ++chunk) {
+    const size_t begin = std::min(count, chunk * step);
+    const size_t end = std::min(count, begin + step);
+    workers.emplace_back([&fn, begin, end, chunk] { fn(begin, end, chunk); });
+  }
+  fn(size_t(0), std::min(count, step), 0u);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return chunks;
+}
+
+// Upper bound on the number of chunks parallelFor hands out.
+inline unsigned maxChunks() {
+  return threadCount();
+}
@@ -0,0 +1,249 @@
+#include "pnm.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pnm {
+namespace {
+
+std::runtime_error systemError(const std::string& what,
+                               const std::string& name) {
+  return std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+/**
+ * Writes every buffer in order with as few writev() calls as possible,
+ * resuming after short writes and retrying on EINTR. Consumes `buffers`.
+ */
+void writeAll(int fd, std::vector<iovec>& buffers, const std::string& name) {
+  size_t first = 0;
+  while (first < buffers.size()) {
+    const int count = int(std::min<size_t>(buffers.size() - first, IOV_MAX));
+    ssize_t written = ::writev(fd, buffers.data() + first, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw systemError("Unable to write", name);
+    }
+    // Skip the buffers written in full and trim the one cut short
+    while (first < buffers.size() &&
+           size_t(written) >= buffers[first].iov_len) {
+      written -= buffers[first].iov_len;
+      ++first;
+    }
+    if (written > 0) {
+      buffers[first].iov_base =
+          static_cast<uint8_t*>(buffers[first].iov_base) + written;
+      buffers[first].iov_len -= written;
+    }
+  }
+}
+
+void writeFile(const std::string& name,
+               const std::string& header,
+               const Mat<uint8_t>& image) {
+  // Header and samples go out in a single writev(): two buffers for a
+  // contiguous Mat, one per run for strided ones
+  std::vector<iovec> buffers;
+  if (!header.empty()) {
+    buffers.push_back({ const_cast<char*>(header.data()), header.size() });
+  }
+  image.forEachRun([&](const uint8_t* run, size_t, size_t count) {
+    buffers.push_back({ const_cast<uint8_t*>(run), count });
+  });
+
+  const int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw systemError("Unable to create", name);
+  }
+  try {
+    writeAll(fd, buffers, name);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+// Hands the mapping over to a Mat whose elements start `offset` bytes in.
+Mat<uint8_t> adoptMapping(MappedFile file,
+                          size_t offset,
+                          const std::vector<size_t>& dimensions) {
+  auto mapping = std::make_shared<MappedFile>(std::move(file));
+  return Mat<uint8_t>::adopt(mapping->data() + offset, dimensions,
+                             [mapping](uint8_t*) {});
+}
+
+class HeaderParser {
+ public:
+  HeaderParser(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+  unsigned number() {
+    skipWhitespaceAndComments();
+    if (mPos >= mSize || !std::isdigit(mData[mPos])) {
+      throw std::runtime_error("Malformed PNM header");
+    }
+    unsigned long value = 0;
+    while (mPos < mSize && std::isdigit(mData[mPos])) {
+      value = value * 10 + (mData[mPos] - '0');
+      if (value > 0xFFFFFFFFul) {
+        throw std::runtime_error("Malformed PNM header");
+      }
+      ++mPos;
+    }
+    return unsigned(value);
+  }
+
+  // Exactly one whitespace character separates the header from the samples
+  size_t endOfHeader() {
+    if (mPos >= mSize || !std::isspace(mData[mPos])) {
+      throw std::runtime_error("Malformed PNM header");
+    }
+    return mPos + 1;
+  }
+
+  size_t position() const { return mPos; }
+  void skip(size_t count) { mPos += count; }
+
+ private:
+  void skipWhitespaceAndComments() {
+    while (mPos < mSize) {
+      if (mData[mPos] == '#') {
+        while (mPos < mSize && mData[mPos] != '\n') {
+          ++mPos;
+        }
+      } else if (std::isspace(mData[mPos])) {
+        ++mPos;
+      } else {
+        return;
+      }
+    }
+  }
+
+  const uint8_t* mData;
+  size_t mSize;
+  size_t mPos = 0;
+};
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& name) {
+  const int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw systemError("Unable to open", name);
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw systemError("Unable to stat", name);
+  }
+  mSize = info.st_size;
+  if (mSize > 0) {
+    void* mapping =
+        ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw systemError("Unable to map", name);
+    }
+    ::madvise(mapping, mSize, MADV_SEQUENTIAL);
+    mData = static_cast<uint8_t*>(mapping);
+  }
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mData(std::exchange(other.mData, nullptr)),
+      mSize(std::exchange(other.mSize, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  std::swap(mData, other.mData);
+  std::swap(mSize, other.mSize);
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (mData) {
+    ::munmap(mData, mSize);
+  }
+}
+
+Header parseHeader(const uint8_t* data, size_t size) {
+  if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+    throw std::runtime_error("Only binary PGM (P5) and PPM (P6) are supported");
+  }
+  HeaderParser parser(data, size);
+  parser.skip(2);
+
+  Header header;
+  header.channels = data[1] == '5' ? 1 : 3;
+  header.width = parser.number();
+  header.height = parser.number();
+  const unsigned maxValue = parser.number();
+  // Samples are adopted as they are, so a smaller maximum would need a
+  // rescaling copy
+  if (maxValue != 255) {
+    throw std::runtime_error("Only PNM samples with a maximum of 255 are "
+                             "supported, not " +
+                             std::to_string(maxValue));
+  }
+  header.dataOffset = parser.endOfHeader();
+
+  const size_t bytes = size_t(header.width) * header.height * header.channels;
+  if (size - header.dataOffset < bytes) {
+    throw std::runtime_error("PNM file is truncated");
+  }
+  return header;
+}
+
+Mat<uint8_t> read(const std::string& name) {
+  MappedFile file(name);
+  const auto header = parseHeader(file.data(), file.size());
+  return adoptMapping(std::move(file), header.dataOffset,
+                      { header.height, header.width, header.channels });
+}
+
+void write(const Mat<uint8_t>& image, const std::string& name) {
+  const auto channels = image.dimension(2);
+  if (channels != 1 && channels != 3) {
+    throw std::runtime_error("PNM output needs 1 or 3 channels");
+  }
+  const std::string header = std::string(channels == 1 ? "P5" : "P6") +
+                             "\n" + std::to_string(image.dimension(1)) + " " +
+                             std::to_string(image.dimension(0)) + "\n255\n";
+  writeFile(name, header, image);
+}
+
+Mat<uint8_t> readRaw(const std::string& name,
+                     unsigned height,
+                     unsigned width,
+                     unsigned channels) {
+  MappedFile file(name);
+  if (file.size() != size_t(height) * width * channels) {
+    throw std::runtime_error(name + " does not hold a " +
+                             std::to_string(height) + "x" +
+                             std::to_string(width) + "x" +
+                             std::to_string(channels) + " image");
+  }
+  return adoptMapping(std::move(file), 0, { height, width, channels });
+}
+
+void writeRaw(const Mat<uint8_t>& image, const std::string& name) {
+  writeFile(name, std::string(), image);
+}
+
+}  // namespace pnm
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mat.hpp"
+
+namespace pnm {
+
+/**
+ * Private, copy-on-write memory mapping of a whole file: writes through
+ * data() never reach the file. The mapping is released when the object is
+ * destroyed.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& name);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  ~MappedFile();
+
+  uint8_t* data() { return mData; }
+  const uint8_t* data() const { return mData; }
+  size_t size() const { return mSize; }
+
+ private:
+  uint8_t* mData = nullptr;
+  size_t mSize = 0;
+};
+
+struct Header {
+  unsigned width, height, channels;
+  // Offset of the first sample from the start of the file
+  size_t dataOffset;
+};
+
+/**
+ * Parses a binary PGM (P5) or PPM (P6) header with 8-bit samples.
+ *
+ * @throws std::runtime_error for other formats, a maximum sample value
+ *         other than 255 (which includes 16-bit files) or a file too short
+ *         for the image it describes
+ */
+Header parseHeader(const uint8_t* data, size_t size);
+
+// Maps a P5/P6 file and returns a height x width x channels Mat that adopts
+// the mapping, so the samples are never copied.
+Mat<uint8_t> read(const std::string& name);
+
+// Writes a 1 channel Mat as P5 or a 3 channel Mat as P6.
+void write(const Mat<uint8_t>& image, const std::string& name);
+
+// Headerless files: just the Mat's samples, row-major and interleaved.
+// readRaw() adopts the mapping like read().
+Mat<uint8_t> readRaw(const std::string& name,
+                     unsigned height,
+                     unsigned width,
+                     unsigned channels);
+void writeRaw(const Mat<uint8_t>& image, const std::string& name);
+
+}  // namespace pnm
@@ -0,0 +1,217 @@
+#include "preview.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace img {
+namespace {
+
+unsigned reduced(unsigned length, unsigned factor) {
+  return (length + factor - 1) / factor;
+}
+
+// Averages factor x factor blocks of rows pushed one at a time, rounding to
+// nearest. Blocks cut off by the right or bottom edge average what they
+// cover.
+class BoxDownsampler {
+ public:
+  BoxDownsampler(unsigned height,
+                 unsigned width,
+                 unsigned channels,
+                 unsigned factor)
+      : mWidth(width),
+        mChannels(channels),
+        mFactor(factor),
+        mOutput(Mat<uint8_t>::uninitialized(
+            { reduced(height, factor), reduced(width, factor), channels })),
+        mSums(size_t(reduced(width, factor)) * channels, 0) {}
+
+  void push(const uint8_t* row) {
+    const unsigned blocks = mWidth / mFactor;
+    const uint8_t* p = row;
+    uint32_t* sum = mSums.data();
+    for (unsigned block = 0; block < blocks; ++block, sum += mChannels) {
+      for (unsigned i = 0; i < mFactor; ++i, p += mChannels) {
+        for (unsigned c = 0; c < mChannels; ++c) {
+          sum[c] += p[c];
+        }
+      }
+    }
+    for (unsigned x = blocks * mFactor; x < mWidth; ++x, p += mChannels) {
+      for (unsigned c = 0; c < mChannels; ++c) {
+        sum[c] += p[c];
+      }
+    }
+    if (++mRowsInBlock == mFactor) {
+      flush();
+    }
+  }
+
+  Mat<uint8_t> finish() {
+    if (mRowsInBlock > 0) {
+      flush();
+    }
+    return std::move(mOutput);
+  }
+
+ private:
+  void flush() {
+    const unsigned outWidth = img::width(mOutput);
+    uint8_t* out = mOutput.data() + size_t(mOutputRow) * outWidth * mChannels;
+    for (unsigned x = 0; x < outWidth; ++x) {
+      const unsigned columns = std::min(mFactor, mWidth - x * mFactor);
+      const uint32_t count = columns * mRowsInBlock;
+      for (unsigned c = 0; c < mChannels; ++c) {
+        uint32_t& sum = mSums[size_t(x) * mChannels + c];
+        out[size_t(x) * mChannels + c] = (sum + count / 2) / count;
+        sum = 0;
+      }
+    }
+    ++mOutputRow;
+    mRowsInBlock = 0;
+  }
+
+  unsigned mWidth;
+  unsigned mChannels;
+  unsigned mFactor;
+  Mat<uint8_t> mOutput;
+  std::vector<uint32_t> mSums;
+  unsigned mRowsInBlock = 0;
+  unsigned mOutputRow = 0;
+};
+
+Mat<uint8_t> downsample(const Mat<uint8_t>& image, unsigned factor) {
+  if (factor == 1) {
+    return image;
+  }
+  BoxDownsampler sampler(height(image), width(image), channel(image), factor);
+  for (unsigned y = 0; y < height(image); ++y) {
+    sampler.push(image.data() + size_t(y) * image.stride(0));
+  }
+  return sampler.finish();
+}
+
+Mat<uint8_t> previewPnm(const std::string& name,
+                        unsigned scale,
+                        const ReadOptions& options) {
+  const pnm::MappedFile file(name);
+  const auto header = pnm::parseHeader(file.data(), file.size());
+  BoxDownsampler sampler(header.height, header.width, header.channels, scale);
+  const size_t rowBytes = size_t(header.width) * header.channels;
+  for (unsigned y = 0; y < header.height; ++y) {
+    sampler.push(file.data() + header.dataOffset + y * rowBytes);
+  }
+  auto preview = sampler.finish();
+  if (options.grayscale && header.channels != 1) {
+    return grayscale(preview, options.weights);
+  }
+  return preview;
+}
+
+// Largest Adam7 grid (every 8th, 4th or 2nd pixel) that divides scale, and
+// the number of passes that complete it.
+std::pair<unsigned, int> adam7Grid(unsigned scale) {
+  if (scale % 8 == 0) {
+    return { 8, 1 };
+  }
+  if (scale % 4 == 0) {
+    return { 4, 3 };
+  }
+  if (scale % 2 == 0) {
+    return { 2, 5 };
+  }
+  return { 1, 7 };
+}
+
+// Reads the first `passes` Adam7 passes, which together cover every pixel
+// whose coordinates are multiples of grid, straight into a reduced Mat.
+Mat<uint8_t> readPasses(libpng::Image& img, unsigned grid, int passes) {
+  const unsigned width = png_get_image_width(img.png, img.info);
+  const unsigned height = png_get_image_height(img.png, img.info);
+  const unsigned channels = png_get_channels(img.png, img.info);
+  auto sampled = Mat<uint8_t>::uninitialized(
+      { reduced(height, grid), reduced(width, grid), channels });
+  const size_t sampledRowBytes = size_t(img::width(sampled)) * channels;
+
+  std::vector<png_byte> row(png_get_rowbytes(img.png, img.info));
+  for (int pass = 0; pass < passes; ++pass) {
+    const unsigned rows = PNG_PASS_ROWS(height, pass);
+    const unsigned columns = PNG_PASS_COLS(width, pass);
+    // libpng skips empty passes
+    if (rows == 0 || columns == 0) {
+      continue;
+    }
+    for (unsigned r = 0; r < rows; ++r) {
+      libpng::readRow(img, row.data());
+      const unsigned y = PNG_PASS_START_ROW(pass) +
+                         (r << PNG_PASS_ROW_SHIFT(pass));
+      uint8_t* out = sampled.data() + (y / grid) * sampledRowBytes;
+      for (unsigned c = 0; c < columns; ++c) {
+        const unsigned x = PNG_PASS_START_COL(pass) +
+                           (c << PNG_PASS_COL_SHIFT(pass));
+        std::memcpy(out + (x / grid) * channels, row.data() + c * channels,
+                    channels);
+      }
+    }
+  }
+  return sampled;
+}
+
+Mat<uint8_t> previewPng(libpng::Image& img,
+                        unsigned scale,
+                        const ReadOptions& options) {
+  const bool interlaced =
+      png_get_interlace_type(img.png, img.info) != PNG_INTERLACE_NONE;
+  const auto [grid, passes] = adam7Grid(scale);
+  if (interlaced && grid == 1) {
+    return downsample(decodePng(img, options), scale);
+  }
+
+  setupPngTransforms(img, options, false);
+  if (interlaced) {
+    const auto sampled = readPasses(img, grid, passes);
+    // The remaining passes are never decoded
+    libpng::clean(img);
+    return downsample(sampled, scale / grid);
+  }
+
+  const unsigned width = png_get_image_width(img.png, img.info);
+  const unsigned height = png_get_image_height(img.png, img.info);
+  const unsigned channels = png_get_channels(img.png, img.info);
+  BoxDownsampler sampler(height, width, channels, scale);
+  std::vector<png_byte> row(png_get_rowbytes(img.png, img.info));
+  for (unsigned y = 0; y < height; ++y) {
+    libpng::readRow(img, row.data());
+    sampler.push(row.data());
+  }
+  libpng::readEnd(img);
+  libpng::clean(img);
+  return sampler.finish();
+}
+
+}  // namespace
+
+Mat<uint8_t> readPreview(const std::string& name,
+                         unsigned scale,
+                         const ReadOptions& options) {
+  if (scale == 0) {
+    throw std::invalid_argument("Preview scale must be at least 1");
+  }
+  if (scale == 1) {
+    return read(name, options);
+  }
+  if (isPnm(name)) {
+    return previewPnm(name, scale, options);
+  }
+  auto img = libpng::open(name);
+  try {
+    return previewPng(img, scale, options);
+  } catch (...) {
+    libpng::clean(img);
+    throw;
+  }
+}
+
+}  // namespace img
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "img.hpp"
+#include "mat.hpp"
+
+namespace img {
+
+/**
+ * Reads a reduced copy of an image, ceil(height / scale) x
+ * ceil(width / scale), without decoding or holding the full-resolution frame
+ * where the file allows it:
+ *
+ * - Adam7-interlaced PNGs decode only the passes needed for the largest of
+ *   the 8x, 4x and 2x grids that divides scale (1, 3 or 5 of the 7 passes)
+ *   and point-sample them. Any remaining factor is box-averaged.
+ * - Non-interlaced PNGs and PNM files are streamed row by row into a box
+ *   filter, keeping one input row and one row of sums in memory.
+ *
+ * Interlaced PNGs whose scale is odd have no usable pass grid and are decoded
+ * in full before averaging.
+ */
+Mat<uint8_t> readPreview(const std::string& name,
+                         unsigned scale,
+                         const ReadOptions& options = {});
+
+}  // namespace img
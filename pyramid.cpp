@@ -0,0 +1,157 @@
+#include "pyramid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+constexpr size_t LEVEL_ALIGNMENT = MatPool::ALIGNMENT;
+constexpr unsigned MIN_SIDE = 3;
+
+unsigned half(unsigned length) {
+  return (length + 1) / 2;
+}
+
+size_t alignUp(size_t bytes) {
+  return (bytes + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+}
+
+// Vertical 5-tap pass over whole source rows, kept as a plain loop over
+// pointers so it vectorizes.
+void verticalSums(const uint8_t* const rows[5], uint16_t* out, size_t n) {
+  const uint8_t* r0 = rows[0];
+  const uint8_t* r1 = rows[1];
+  const uint8_t* r2 = rows[2];
+  const uint8_t* r3 = rows[3];
+  const uint8_t* r4 = rows[4];
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = uint16_t(r0[i] + r4[i] + 4 * (r1[i] + r3[i]) + 6 * r2[i]);
+  }
+}
+
+// Horizontal 5-tap pass over a padded row of vertical sums, evaluated only
+// at even columns. CHANNELS is the channel count when known at compile time,
+// or 0 to use `channels`.
+template <unsigned CHANNELS>
+void decimateRow(const uint16_t* padded,
+                 uint8_t* out,
+                 unsigned outWidth,
+                 unsigned channels) {
+  const unsigned C = CHANNELS ? CHANNELS : channels;
+  for (unsigned x = 0; x < outWidth; ++x) {
+    const uint16_t* p = padded + 2 * x * C;
+    for (unsigned c = 0; c < C; ++c) {
+      const uint16_t* q = p + c;
+      const uint16_t sum = q[0] + 4 * (q[C] + q[3 * C]) + 6 * q[2 * C] +
+                           q[4 * C];
+      out[x * C + c] = (sum + 128) >> 8;
+    }
+  }
+}
+
+}  // namespace
+
+void pyramidDown(const Mat<uint8_t>& input, Mat<uint8_t>& output) {
+  const unsigned height = img::height(input);
+  const unsigned width = img::width(input);
+  const unsigned channels = img::channel(input);
+  if (height < MIN_SIDE || width < MIN_SIDE) {
+    throw std::invalid_argument("pyramidDown needs at least 3x3 pixels");
+  }
+  const unsigned outHeight = half(height);
+  const unsigned outWidth = half(width);
+  if (output.shape() != std::vector<size_t>{ outHeight, outWidth, channels } ||
+      !output.isContiguous()) {
+    throw std::invalid_argument(
+        "pyramidDown needs a contiguous " + std::to_string(outHeight) + "x" +
+        std::to_string(outWidth) + "x" + std::to_string(channels) +
+        " output");
+  }
+  if (input.stride(2) != 1 || input.stride(1) != channels) {
+    pyramidDown(Mat<uint8_t>(input), output);
+    return;
+  }
+  const size_t inPitch = input.stride(0);
+  const size_t outPitch = output.stride(0);
+
+  // Per output row: the vertical 5-tap sums of the source rows, padded with
+  // two mirrored pixels on each side so the horizontal pass has no branches.
+  // Sums stay below 256 * 255 + 128 and fit in 16 bits throughout.
+  const size_t paddedWidth = size_t(width + 4) * channels;
+  parallelFor(
+      outHeight, std::max(1u, (1u << 15) / width),
+      [&](size_t begin, size_t end, unsigned) {
+        std::vector<uint16_t> sums(paddedWidth);
+        for (size_t y = begin; y < end; ++y) {
+          const int center = int(y) * 2;
+          const uint8_t* rows[5];
+          for (int k = 0; k < 5; ++k) {
+            rows[k] = input.data() +
+                      mirror(center + k - 2, int(height)) * inPitch;
+          }
+          uint16_t* padded = sums.data();
+          verticalSums(rows, padded + 2 * channels, size_t(width) * channels);
+          // Source columns -2, -1, width and width + 1, mirrored
+          for (unsigned c = 0; c < channels; ++c) {
+            padded[c] = padded[4 * channels + c];
+            padded[channels + c] = padded[3 * channels + c];
+            padded[(width + 2) * channels + c] = padded[width * channels + c];
+            padded[(width + 3) * channels + c] =
+                padded[(width - 1) * channels + c];
+          }
+
+          uint8_t* out = output.data() + y * outPitch;
+          switch (channels) {
+            case 1:
+              decimateRow<1>(padded, out, outWidth, channels);
+              break;
+            case 3:
+              decimateRow<3>(padded, out, outWidth, channels);
+              break;
+            case 4:
+              decimateRow<4>(padded, out, outWidth, channels);
+              break;
+            default:
+              decimateRow<0>(padded, out, outWidth, channels);
+          }
+        }
+      });
+}
+
+ImagePyramid::ImagePyramid(const Mat<uint8_t>& image, unsigned maxLevels) {
+  std::vector<std::vector<size_t>> shapes;
+  std::vector<size_t> offsets;
+  size_t total = 0;
+  unsigned height = img::height(image);
+  unsigned width = img::width(image);
+  const unsigned channels = img::channel(image);
+  while (maxLevels == 0 || shapes.size() < maxLevels) {
+    shapes.push_back({ height, width, channels });
+    offsets.push_back(total);
+    total += alignUp(size_t(height) * width * channels);
+    if (height < MIN_SIDE || width < MIN_SIDE) {
+      break;
+    }
+    height = half(height);
+    width = half(width);
+  }
+
+  mStorage.resize(total);
+  mLevels.reserve(shapes.size());
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    mLevels.push_back(
+        Mat<uint8_t>::borrow(mStorage.data() + offsets[i], shapes[i]));
+  }
+
+  uint8_t* base = mLevels[0].data();
+  image.forEachRun([base](const uint8_t* run, size_t position, size_t count) {
+    std::copy(run, run + count, base + position);
+  });
+  for (size_t i = 1; i < mLevels.size(); ++i) {
+    pyramidDown(mLevels[i - 1], mLevels[i]);
+  }
+}
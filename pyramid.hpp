@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mat.hpp"
+
+/**
+ * Gaussian image pyramid. Level 0 is a copy of the input and every further
+ * level halves both sides (rounding up) of the one before, blurring with the
+ * 5-tap binomial kernel {1, 4, 6, 4, 1} / 16 in both directions. Blur and
+ * decimation are fused, so only the samples that are kept get computed and
+ * building all levels costs about 4/3 of a pass over the input.
+ *
+ * All levels share one allocation; level() hands out Mats that borrow it and
+ * stay valid for the lifetime of the pyramid, moves included.
+ */
+class ImagePyramid {
+ public:
+  /**
+   * @param maxLevels Number of levels to build, including level 0; 0 builds
+   *                  as many as possible. Levels stop once a side is too
+   *                  short (under 3 pixels) for the kernel's mirrored border.
+   */
+  explicit ImagePyramid(const Mat<uint8_t>& image, unsigned maxLevels = 0);
+
+  ImagePyramid(const ImagePyramid&) = delete;
+  ImagePyramid& operator=(const ImagePyramid&) = delete;
+  ImagePyramid(ImagePyramid&&) = default;
+  ImagePyramid& operator=(ImagePyramid&&) = default;
+
+  unsigned levels() const { return mLevels.size(); }
+
+  // Level i is 2^i times smaller than the input in each direction.
+  Mat<uint8_t>& level(unsigned index) { return mLevels.at(index); }
+  const Mat<uint8_t>& level(unsigned index) const {
+    return mLevels.at(index);
+  }
+  Mat<uint8_t>& operator[](unsigned index) { return mLevels[index]; }
+  const Mat<uint8_t>& operator[](unsigned index) const {
+    return mLevels[index];
+  }
+
+ private:
+  Mat<uint8_t>::storage_t mStorage;
+  std::vector<Mat<uint8_t>> mLevels;
+};
+
+/**
+ * Blurs `input` with {1, 4, 6, 4, 1} / 16 in both directions and keeps every
+ * second row and column, writing the ceil(h / 2) x ceil(w / 2) result to
+ * `output`. Borders are mirrored like in convolute(). Inputs whose rows are
+ * not packed are copied first.
+ *
+ * @throws std::invalid_argument if the input has fewer than 3 rows or
+ *         columns, or output is not a contiguous Mat of that shape
+ */
+void pyramidDown(const Mat<uint8_t>& input, Mat<uint8_t>& output);
@@ -0,0 +1,379 @@
+#include "resize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "img.hpp"
+#include "parallel.hpp"
+
+namespace img {
+namespace {
+
+// uint8 weights are Q14 and horizontally filtered rows keep 7 fractional
+// bits, so 255 << 7 fits in int16 and a vertical sum in int32.
+constexpr unsigned WEIGHT_BITS = 14;
+constexpr unsigned INTERMEDIATE_BITS = 7;
+constexpr unsigned HORIZONTAL_SHIFT = WEIGHT_BITS - INTERMEDIATE_BITS;
+constexpr unsigned VERTICAL_SHIFT = WEIGHT_BITS + INTERMEDIATE_BITS;
+
+template <typename T>
+struct ResizeTypes;
+
+template <>
+struct ResizeTypes<uint8_t> {
+  using weight_t = int16_t;
+  using intermediate_t = int16_t;
+  using accumulator_t = int32_t;
+};
+
+template <>
+struct ResizeTypes<float> {
+  using weight_t = float;
+  using intermediate_t = float;
+  using accumulator_t = float;
+};
+
+/**
+ * Coefficients of one axis: output i blends the `taps` source samples from
+ * start[i] on. Windows are shifted to stay inside the source, with the
+ * weight of clamped samples folded onto the edge.
+ */
+struct AxisTable {
+  unsigned taps = 1;
+  std::vector<unsigned> start;
+  std::vector<float> weights;
+  // Q14 copy of weights; every window sums to exactly 1 << WEIGHT_BITS
+  std::vector<int16_t> fixedWeights;
+
+  template <typename W>
+  const W* weightsOf(unsigned index) const {
+    if constexpr (std::is_same_v<W, float>) {
+      return weights.data() + size_t(index) * taps;
+    } else {
+      return fixedWeights.data() + size_t(index) * taps;
+    }
+  }
+};
+
+AxisTable makeAxis(unsigned source, unsigned target, Interpolation mode) {
+  const double scale = double(source) / target;
+  if (mode == Interpolation::AREA && scale <= 1) {
+    mode = Interpolation::BILINEAR;
+  }
+  const auto clampIndex = [source](double index) {
+    return unsigned(std::clamp(index, 0.0, double(source - 1)));
+  };
+
+  std::vector<std::vector<std::pair<unsigned, double>>> contributions(target);
+  for (unsigned i = 0; i < target; ++i) {
+    auto& taps = contributions[i];
+    switch (mode) {
+      case Interpolation::NEAREST:
+        taps.push_back({ clampIndex(std::floor((i + 0.5) * scale)), 1.0 });
+        break;
+      case Interpolation::BILINEAR: {
+        const double center = std::max(0.0, (i + 0.5) * scale - 0.5);
+        const double first = std::floor(center);
+        const double fraction = center - first;
+        taps.push_back({ clampIndex(first), 1 - fraction });
+        taps.push_back({ clampIndex(first + 1), fraction });
+        break;
+      }
+      case Interpolation::AREA: {
+        const double begin = i * scale;
+        const double end = std::min((i + 1) * scale, double(source));
+        for (double j = std::floor(begin); j < end; ++j) {
+          const double overlap = std::min(end, j + 1) - std::max(begin, j);
+          if (overlap > 1e-9) {
+            taps.push_back({ clampIndex(j), overlap / (end - begin) });
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  AxisTable table;
+  std::vector<unsigned> lowest(target);
+  for (unsigned i = 0; i < target; ++i) {
+    unsigned lo = source, hi = 0;
+    for (const auto& [index, weight] : contributions[i]) {
+      lo = std::min(lo, index);
+      hi = std::max(hi, index);
+    }
+    lowest[i] = lo;
+    table.taps = std::max(table.taps, hi - lo + 1);
+  }
+
+  table.start.resize(target);
+  table.weights.assign(size_t(target) * table.taps, 0.0f);
+  table.fixedWeights.assign(table.weights.size(), 0);
+  for (unsigned i = 0; i < target; ++i) {
+    const unsigned start = std::min(lowest[i], source - table.taps);
+    table.start[i] = start;
+    float* weights = table.weights.data() + size_t(i) * table.taps;
+    for (const auto& [index, weight] : contributions[i]) {
+      weights[index - start] += float(weight);
+    }
+
+    int16_t* fixed = table.fixedWeights.data() + size_t(i) * table.taps;
+    int sum = 0;
+    unsigned largest = 0;
+    for (unsigned k = 0; k < table.taps; ++k) {
+      fixed[k] = int16_t(std::lrint(weights[k] * (1 << WEIGHT_BITS)));
+      sum += fixed[k];
+      largest = fixed[k] > fixed[largest] ? k : largest;
+    }
+    fixed[largest] += (1 << WEIGHT_BITS) - sum;
+  }
+  return table;
+}
+
+// Converts a horizontal sum to the intermediate type.
+template <typename T>
+typename ResizeTypes<T>::intermediate_t narrow(
+    typename ResizeTypes<T>::accumulator_t sum) {
+  if constexpr (std::is_same_v<T, uint8_t>) {
+    return int16_t((sum + (1 << (HORIZONTAL_SHIFT - 1))) >> HORIZONTAL_SHIFT);
+  } else {
+    return sum;
+  }
+}
+
+// Filters one source row along x into `out`. CHANNELS and TAPS are the
+// channel and tap counts when known at compile time, or 0 to read them from
+// `channels` and the table.
+template <unsigned CHANNELS, unsigned TAPS, typename T>
+void horizontalPass(const T* src,
+                    typename ResizeTypes<T>::intermediate_t* out,
+                    const AxisTable& axis,
+                    unsigned width,
+                    unsigned channels) {
+  using W = typename ResizeTypes<T>::weight_t;
+  using A = typename ResizeTypes<T>::accumulator_t;
+  const unsigned C = CHANNELS ? CHANNELS : channels;
+  const unsigned taps = TAPS ? TAPS : axis.taps;
+  const unsigned* starts = axis.start.data();
+  const W* weights = axis.weightsOf<W>(0);
+  for (unsigned x = 0; x < width; ++x) {
+    const T* p = src + size_t(starts[x]) * C;
+    const W* w = weights + size_t(x) * taps;
+    if constexpr (CHANNELS != 0) {
+      // Whole pixels per tap, with the sums kept in registers
+      A sums[CHANNELS] = {};
+      for (unsigned k = 0; k < taps; ++k, p += CHANNELS) {
+        const A weight = w[k];
+        for (unsigned c = 0; c < CHANNELS; ++c) {
+          sums[c] += weight * A(p[c]);
+        }
+      }
+      for (unsigned c = 0; c < CHANNELS; ++c) {
+        out[x * CHANNELS + c] = narrow<T>(sums[c]);
+      }
+    } else {
+      for (unsigned c = 0; c < C; ++c) {
+        A sum = 0;
+        for (unsigned k = 0; k < taps; ++k) {
+          sum += A(w[k]) * A(p[k * C + c]);
+        }
+        out[x * C + c] = narrow<T>(sum);
+      }
+    }
+  }
+}
+
+// Two taps cover bilinear and 2x area, three area up to 3x.
+template <unsigned CHANNELS, typename T>
+void horizontalPassByTaps(const T* src,
+                          typename ResizeTypes<T>::intermediate_t* out,
+                          const AxisTable& axis,
+                          unsigned width,
+                          unsigned channels) {
+  switch (axis.taps) {
+    case 2:
+      return horizontalPass<CHANNELS, 2>(src, out, axis, width, channels);
+    case 3:
+      return horizontalPass<CHANNELS, 3>(src, out, axis, width, channels);
+    default:
+      return horizontalPass<CHANNELS, 0>(src, out, axis, width, channels);
+  }
+}
+
+template <typename T>
+void horizontalPass(const T* src,
+                    typename ResizeTypes<T>::intermediate_t* out,
+                    const AxisTable& axis,
+                    unsigned width,
+                    unsigned channels) {
+  switch (channels) {
+    case 1:
+      return horizontalPassByTaps<1>(src, out, axis, width, channels);
+    case 3:
+      return horizontalPassByTaps<3>(src, out, axis, width, channels);
+    case 4:
+      return horizontalPassByTaps<4>(src, out, axis, width, channels);
+    default:
+      return horizontalPassByTaps<0>(src, out, axis, width, channels);
+  }
+}
+
+// Blends the filtered rows of one output row. Each loop runs over a whole
+// row, which the compiler vectorizes.
+template <typename T>
+void verticalPass(const typename ResizeTypes<T>::intermediate_t* const* rows,
+                  const typename ResizeTypes<T>::weight_t* weights,
+                  unsigned taps,
+                  typename ResizeTypes<T>::accumulator_t* sums,
+                  T* out,
+                  size_t n) {
+  using A = typename ResizeTypes<T>::accumulator_t;
+  const A w0 = weights[0];
+  const auto* r0 = rows[0];
+  for (size_t i = 0; i < n; ++i) {
+    sums[i] = w0 * A(r0[i]);
+  }
+  for (unsigned k = 1; k < taps; ++k) {
+    const A w = weights[k];
+    const auto* r = rows[k];
+    for (size_t i = 0; i < n; ++i) {
+      sums[i] += w * A(r[i]);
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      const int32_t value =
+          (sums[i] + (1 << (VERTICAL_SHIFT - 1))) >> VERTICAL_SHIFT;
+      out[i] = uint8_t(std::clamp(value, 0, 255));
+    } else {
+      out[i] = sums[i];
+    }
+  }
+}
+
+template <unsigned CHANNELS, typename T>
+void nearestRow(const T* src,
+                T* out,
+                const AxisTable& axis,
+                unsigned width,
+                unsigned channels) {
+  const unsigned C = CHANNELS ? CHANNELS : channels;
+  for (unsigned x = 0; x < width; ++x) {
+    const T* p = src + size_t(axis.start[x]) * C;
+    for (unsigned c = 0; c < C; ++c) {
+      out[x * C + c] = p[c];
+    }
+  }
+}
+
+template <typename T>
+Mat<T> resizeNearest(const Mat<T>& image,
+                     const AxisTable& rows,
+                     const AxisTable& columns,
+                     unsigned height,
+                     unsigned width) {
+  const unsigned channels = channel(image);
+  const size_t pitch = image.stride(0);
+  const size_t rowLength = size_t(width) * channels;
+  auto output = Mat<T>::uninitialized({ height, width, channels });
+  parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / rowLength),
+      [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+          const T* src = image.data() + rows.start[y] * pitch;
+          T* out = output.data() + y * rowLength;
+          switch (channels) {
+            case 1:
+              nearestRow<1>(src, out, columns, width, channels);
+              break;
+            case 3:
+              nearestRow<3>(src, out, columns, width, channels);
+              break;
+            case 4:
+              nearestRow<4>(src, out, columns, width, channels);
+              break;
+            default:
+              nearestRow<0>(src, out, columns, width, channels);
+          }
+        }
+      });
+  return output;
+}
+
+template <typename T>
+Mat<T> resizeImage(const Mat<T>& image,
+                   unsigned height,
+                   unsigned width,
+                   Interpolation mode) {
+  using I = typename ResizeTypes<T>::intermediate_t;
+  using W = typename ResizeTypes<T>::weight_t;
+  using A = typename ResizeTypes<T>::accumulator_t;
+
+  const unsigned sourceHeight = img::height(image);
+  const unsigned sourceWidth = img::width(image);
+  const unsigned channels = channel(image);
+  if (sourceHeight == 0 || sourceWidth == 0 || height == 0 || width == 0) {
+    throw std::invalid_argument("resize: images must not be empty");
+  }
+  if (image.stride(2) != 1 || image.stride(1) != channels) {
+    return resizeImage(Mat<T>(image), height, width, mode);
+  }
+
+  const auto rows = makeAxis(sourceHeight, height, mode);
+  const auto columns = makeAxis(sourceWidth, width, mode);
+  if (mode == Interpolation::NEAREST) {
+    return resizeNearest(image, rows, columns, height, width);
+  }
+
+  const size_t pitch = image.stride(0);
+  const size_t rowLength = size_t(width) * channels;
+  const unsigned taps = rows.taps;
+  auto output = Mat<T>::uninitialized({ height, width, channels });
+  parallelFor(
+      height, std::max<size_t>(1, (1 << 16) / rowLength),
+      [&](size_t begin, size_t end, unsigned) {
+        // Ring of horizontally filtered source rows, slot = row % taps.
+        // Window starts never decrease, so each source row is filtered
+        // once per band.
+        std::vector<I> ring(taps * rowLength);
+        std::vector<A> sums(rowLength);
+        std::vector<const I*> window(taps);
+        unsigned next = rows.start[begin];
+        for (size_t y = begin; y < end; ++y) {
+          const unsigned first = rows.start[y];
+          next = std::max(next, first);
+          for (; next < first + taps; ++next) {
+            horizontalPass(image.data() + next * pitch,
+                           ring.data() + (next % taps) * rowLength, columns,
+                           width, channels);
+          }
+          for (unsigned k = 0; k < taps; ++k) {
+            window[k] = ring.data() + ((first + k) % taps) * rowLength;
+          }
+          verticalPass(window.data(), rows.weightsOf<W>(y), taps,
+                       sums.data(), output.data() + y * rowLength,
+                       rowLength);
+        }
+      });
+  return output;
+}
+
+}  // namespace
+
+Mat<uint8_t> resize(const Mat<uint8_t>& image,
+                    unsigned height,
+                    unsigned width,
+                    Interpolation mode) {
+  return resizeImage(image, height, width, mode);
+}
+
+Mat<float> resize(const Mat<float>& image,
+                  unsigned height,
+                  unsigned width,
+                  Interpolation mode) {
+  return resizeImage(image, height, width, mode);
+}
+
+}  // namespace img
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+#include "mat.hpp"
+
+namespace img {
+
+enum class Interpolation {
+  // Pixel whose center is closest to the output pixel's center
+  NEAREST,
+  // Linear blend of the two nearest pixels in each direction
+  BILINEAR,
+  // Average over the covered source area, weighted by overlap. The right
+  // choice for shrinking; enlarging falls back to BILINEAR.
+  AREA,
+};
+
+/**
+ * Resamples a height x width x channels image to the given size.
+ *
+ * The filter is separable: per-axis coefficient tables are built once, then
+ * each output row blends a few horizontally filtered source rows, which are
+ * computed once and kept in a small ring per thread. uint8 images use 14-bit
+ * fixed-point weights and 16-bit intermediates; float images use float
+ * weights. The horizontal pass is specialized for 1, 3 and 4 channels, and
+ * output rows are split into bands across threads. Borders replicate the
+ * edge pixels.
+ *
+ * @throws std::invalid_argument for an empty source or target
+ */
+Mat<uint8_t> resize(const Mat<uint8_t>& image,
+                    unsigned height,
+                    unsigned width,
+                    Interpolation mode = Interpolation::BILINEAR);
+Mat<float> resize(const Mat<float>& image,
+                  unsigned height,
+                  unsigned width,
+                  Interpolation mode = Interpolation::BILINEAR);
+
+}  // namespace img
@@ -17,7 +17,7 @@ std::pair<Mat<double>, Mat<double>> sobelXYGradients(
   auto bufferY = convolute<uint8_t, double>(input, sobelYKernalRow);
   bufferY = convolute<double>(bufferY, sobelYKernalCol);
 
-  return { bufferX, bufferY };
+  return { std::move(bufferX), std::move(bufferY) };
 }
 
 Mat<uint8_t> sobel(const Mat<uint8_t>& input) {
@@ -26,7 +26,7 @@ Mat<uint8_t> sobel(const Mat<uint8_t>& input) {
   const auto height = img::height(input);
   const auto width = img::width(input);
 
-  Mat<uint8_t> output = { { height, width, 1 } };
+  auto output = Mat<uint8_t>::uninitialized({ height, width, 1 });
 
   for (unsigned y = 0; y < height; ++y) {
     for (unsigned x = 0; x < width; ++x) {
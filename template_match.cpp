@@ -0,0 +1,134 @@
+#include "template_match.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "fft_convolution.hpp"
+#include "img.hpp"
+#include "integral_image.hpp"
+#include "parallel.hpp"
+
+Mat<float> matchTemplate(const Mat<uint8_t>& image, const Mat<uint8_t>& templ) {
+  if (img::channel(image) != 1 || img::channel(templ) != 1) {
+    throw std::invalid_argument("matchTemplate: inputs need 1 channel");
+  }
+  const unsigned height = img::height(image), width = img::width(image);
+  const unsigned rows = img::height(templ), cols = img::width(templ);
+  if (rows == 0 || cols == 0 || rows > height || cols > width) {
+    throw std::invalid_argument("matchTemplate: template does not fit");
+  }
+  const Mat<uint8_t> dense = templ;
+  const int64_t n = int64_t(rows) * cols;
+
+  // n times the template's variance, exactly
+  int64_t sum = 0, squares = 0;
+  for (auto it = dense.cbegin(); it != dense.cend(); ++it) {
+    const int64_t value = *it;
+    sum += value;
+    squares += value * value;
+  }
+  const int64_t templateSpread = n * squares - sum * sum;
+  auto scores = Mat<float>({ height - rows + 1, width - cols + 1, 1 });
+  if (templateSpread == 0) {
+    return scores;
+  }
+
+  // Correlating with the zero-mean template leaves out the window mean
+  const double mean = double(sum) / n;
+  Mat<double> kernel({ rows, cols }, [&](unsigned i) -> double {
+    return dense.data()[i] - mean;
+  });
+  std::vector<double> plane(size_t(height) * width);
+  for (unsigned y = 0; y < height; ++y) {
+    for (unsigned x = 0; x < width; ++x) {
+      plane[size_t(y) * width + x] = image.data()[y * image.stride(0) +
+                                                  x * image.stride(1)];
+    }
+  }
+  std::vector<double> correlation(plane.size());
+  fft::correlatePlanes(plane.data(), 1, height, width, { &kernel },
+                       { correlation.data() });
+
+  const IntegralImage table(image, true);
+  const double templateEnergy = double(templateSpread) / n;
+  const unsigned outWidth = width - cols + 1;
+  parallelFor(
+      img::height(scores), std::max<size_t>(1, (1 << 14) / outWidth),
+      [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+          // The correlation is anchored on the template's center
+          const double* numerators =
+              correlation.data() + (y + rows / 2) * width + cols / 2;
+          float* out = scores.data() + y * outWidth;
+          for (unsigned x = 0; x < outWidth; ++x) {
+            const unsigned x1 = x + cols - 1, y1 = unsigned(y) + rows - 1;
+            const int64_t windowSum = table.getSum(x, y, x1, y1);
+            const int64_t windowSpread =
+                n * table.getSquaredSum(x, y, x1, y1) - windowSum * windowSum;
+            if (windowSpread <= 0) {
+              out[x] = 0;
+              continue;
+            }
+            const double score =
+                numerators[x] /
+                std::sqrt(double(windowSpread) / n * templateEnergy);
+            out[x] = float(std::clamp(score, -1.0, 1.0));
+          }
+        }
+      });
+  return scores;
+}
+
+std::vector<TemplateMatch> bestMatches(const Mat<float>& scores,
+                                       unsigned count,
+                                       unsigned minDistance) {
+  const int height = img::height(scores), width = img::width(scores);
+  std::vector<TemplateMatch> peaks;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const float score = scores[y][x][0];
+      bool peak = true;
+      for (int dy = -1; dy <= 1 && peak; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int ny = y + dy, nx = x + dx;
+          if ((dy == 0 && dx == 0) || ny < 0 || ny >= height || nx < 0 ||
+              nx >= width) {
+            continue;
+          }
+          // Ties go to the first position in scan order
+          const float other = scores[ny][nx][0];
+          const bool before = dy < 0 || (dy == 0 && dx < 0);
+          if (other > score || (before && other == score)) {
+            peak = false;
+            break;
+          }
+        }
+      }
+      if (peak) {
+        peaks.push_back({ unsigned(x), unsigned(y), score });
+      }
+    }
+  }
+  std::stable_sort(peaks.begin(), peaks.end(),
+                   [](const TemplateMatch& a, const TemplateMatch& b) {
+                     return a.score > b.score;
+                   });
+
+  std::vector<TemplateMatch> kept;
+  for (const auto& peak : peaks) {
+    if (kept.size() == count) {
+      break;
+    }
+    const bool isolated =
+        std::none_of(kept.begin(), kept.end(), [&](const TemplateMatch& m) {
+          return std::max(std::abs(int(m.x) - int(peak.x)),
+                          std::abs(int(m.y) - int(peak.y))) <
+                 int(minDistance);
+        });
+    if (isolated) {
+      kept.push_back(peak);
+    }
+  }
+  return kept;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "mat.hpp"
+
+/**
+ * Zero-mean normalized cross-correlation of a template at every position
+ * where it fits inside a single channel image. scores[y][x] is in [-1, 1]
+ * for the window whose top-left corner is (x, y), 1 where the window is
+ * the template up to brightness and contrast. Windows or templates without
+ * any variance score 0.
+ *
+ * The numerator is the correlation with the zero-mean template, computed
+ * through fft::correlatePlanes(). The window means and variances of the
+ * denominator come from an IntegralImage with a squared-sum table, at
+ * constant cost per position.
+ *
+ * @throws std::invalid_argument for multi-channel inputs or a template
+ *         larger than the image
+ */
+Mat<float> matchTemplate(const Mat<uint8_t>& image, const Mat<uint8_t>& templ);
+
+struct TemplateMatch {
+  unsigned x, y;
+  float score;
+};
+
+/**
+ * Up to `count` best positions of a score map, best first. Each is a local
+ * maximum, and at least minDistance pixels away along x or y from every
+ * better match that was kept.
+ */
+std::vector<TemplateMatch> bestMatches(const Mat<float>& scores,
+                                       unsigned count,
+                                       unsigned minDistance = 1);
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "canny.hpp"
+#include "catch.hpp"
+#include "img.hpp"
+#include "sobel.hpp"
+
+TEST_CASE("Percentile canny thresholds", "[canny]") {
+  MagnitudeHistogram histogram{};
+  for (unsigned level = 0; level < 10; ++level) {
+    histogram[level] = 10;
+  }
+  // 80 of the 100 pixels are below 8, only 70 below 7
+  REQUIRE(cannyThresholds(histogram) == std::pair<uint8_t, uint8_t>(3, 8));
+
+  CannyAutoOptions options;
+  options.highQuantile = 0.95;
+  options.lowRatio = 0.5;
+  REQUIRE(cannyThresholds(histogram, options) ==
+          std::pair<uint8_t, uint8_t>(5, 10));
+
+  // A blank image still gets a high threshold above 0
+  MagnitudeHistogram blank{};
+  blank[0] = 1000;
+  REQUIRE(cannyThresholds(blank).second == 1);
+}
+
+TEST_CASE("Otsu canny thresholds split the modes", "[canny]") {
+  MagnitudeHistogram histogram{};
+  for (unsigned level = 0; level < 20; ++level) {
+    histogram[level] = 100;
+  }
+  for (unsigned level = 150; level < 170; ++level) {
+    histogram[level] = 10;
+  }
+  CannyAutoOptions options;
+  options.method = CannyAutoOptions::Method::OTSU;
+  options.lowRatio = 0.5;
+  const auto [low, high] = cannyThresholds(histogram, options);
+  REQUIRE(high >= 20);
+  REQUIRE(high <= 150);
+  REQUIRE(low == std::lround(high * 0.5));
+}
+
+TEST_CASE("Automatic canny matches the fixed thresholds it picks",
+          "[canny]") {
+  Mat<uint8_t> image({ 40, 50, 1 }, [](unsigned i) -> uint8_t {
+    const unsigned y = i / 50, x = i % 50;
+    const bool inside = y > 10 && y < 30 && x > 15 && x < 40;
+    return uint8_t((inside ? 180 : 60) + ((i * 2654435761u) >> 28));
+  });
+
+  // The histogram counted by the gradient pass
+  const auto [gradientX, gradientY] = sobelXYGradients(image);
+  MagnitudeHistogram histogram{};
+  for (unsigned y = 0; y < 40; ++y) {
+    for (unsigned x = 0; x < 50; ++x) {
+      const double magnitude =
+          std::hypot(gradientX[y][x][0], gradientY[y][x][0]);
+      ++histogram[unsigned(std::min(std::round(magnitude), 255.0))];
+    }
+  }
+
+  for (const auto method : { CannyAutoOptions::Method::PERCENTILE,
+                             CannyAutoOptions::Method::OTSU }) {
+    CannyAutoOptions options;
+    options.method = method;
+    options.highQuantile = 0.9;
+    std::pair<uint8_t, uint8_t> thresholds;
+    const auto edges = canny(image, options, &thresholds);
+    REQUIRE(thresholds == cannyThresholds(histogram, options));
+
+    const auto expected = canny(image, thresholds.first, thresholds.second);
+    REQUIRE(std::equal(edges.cbegin(), edges.cend(), expected.cbegin()));
+    // The square's outline is found
+    REQUIRE(edges[20][15][0] + edges[20][16][0] > 0);
+  }
+}
+
+TEST_CASE("Canny thresholds reject bad options", "[canny]") {
+  CannyAutoOptions options;
+  options.lowRatio = 1.5;
+  REQUIRE_THROWS_AS(cannyThresholds(MagnitudeHistogram{}, options),
+                    std::invalid_argument);
+  options.lowRatio = 0.5;
+  options.highQuantile = -0.1;
+  REQUIRE_THROWS_AS(cannyThresholds(MagnitudeHistogram{}, options),
+                    std::invalid_argument);
+}
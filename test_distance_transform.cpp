@@ -0,0 +1,65 @@
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "catch.hpp"
+#include "distance_transform.hpp"
+#include "img.hpp"
+
+namespace {
+Mat<uint8_t> sparseEdges(unsigned height, unsigned width, unsigned percent) {
+  return Mat<uint8_t>({ height, width, 1 }, [percent](unsigned i) -> uint8_t {
+    return ((i * 2654435761u) >> 24) * 100 < percent * 256 ? 255 : 0;
+  });
+}
+
+// Nearest edge pixel by checking all of them
+float bruteForceDistance(const Mat<uint8_t>& mask, int y, int x) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int ey = 0; ey < int(img::height(mask)); ++ey) {
+    for (int ex = 0; ex < int(img::width(mask)); ++ex) {
+      if (mask[ey][ex][0]) {
+        best = std::min(best, std::hypot(double(ey - y), double(ex - x)));
+      }
+    }
+  }
+  return float(best);
+}
+}  // namespace
+
+TEST_CASE("Distance transform is exact", "[distance]") {
+  for (unsigned percent : { 1u, 5u, 40u }) {
+    const auto mask = sparseEdges(37, 300, percent);
+    const auto distances = distanceTransform(mask);
+    REQUIRE(distances.shape() == mask.shape());
+    for (int y = 0; y < 37; ++y) {
+      for (int x = 0; x < 300; x += 7) {
+        REQUIRE(distances[y][x][0] == Approx(bruteForceDistance(mask, y, x)));
+      }
+    }
+  }
+}
+
+TEST_CASE("Distance to a single edge pixel", "[distance]") {
+  Mat<uint8_t> mask({ 9, 12, 1 });
+  mask[2][3][0] = 255;
+  const auto distances = distanceTransform(mask);
+  for (int y = 0; y < 9; ++y) {
+    for (int x = 0; x < 12; ++x) {
+      REQUIRE(distances[y][x][0] ==
+              Approx(std::hypot(double(y - 2), double(x - 3))));
+    }
+  }
+}
+
+TEST_CASE("Distance transform of an empty mask", "[distance]") {
+  const auto distances = distanceTransform(Mat<uint8_t>({ 4, 5, 1 }));
+  REQUIRE(std::all_of(distances.cbegin(), distances.cend(),
+                      [](float d) { return d == NO_EDGE_DISTANCE; }));
+  REQUIRE(std::isfinite(NO_EDGE_DISTANCE));
+}
+
+TEST_CASE("Distance transform rejects multi-channel masks", "[distance]") {
+  REQUIRE_THROWS_AS(distanceTransform(Mat<uint8_t>({ 2, 2, 3 })),
+                    std::invalid_argument);
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "catch.hpp"
+#include "equalize.hpp"
+#include "img.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+// Reference tile table: clipped, redistributed and accumulated
+std::array<uint8_t, 256> bruteForceTileLut(const Mat<uint8_t>& image,
+                                           unsigned top,
+                                           unsigned bottom,
+                                           unsigned left,
+                                           unsigned right,
+                                           double clipLimit) {
+  std::array<unsigned, 256> histogram{};
+  for (unsigned y = top; y < bottom; ++y) {
+    for (unsigned x = left; x < right; ++x) {
+      ++histogram[image[y][x][0]];
+    }
+  }
+  const unsigned area = (bottom - top) * (right - left);
+  const unsigned limit = std::max(1u, unsigned(clipLimit * area / 256));
+  unsigned excess = 0;
+  for (auto& count : histogram) {
+    excess += count > limit ? count - limit : 0;
+    count = std::min(count, limit);
+  }
+  for (auto& count : histogram) {
+    count += excess / 256;
+  }
+  const unsigned remainder = excess % 256;
+  for (unsigned i = 0; i < remainder; ++i) {
+    ++histogram[i * std::max(1u, 256 / remainder)];
+  }
+  std::array<uint8_t, 256> lut;
+  unsigned cumulative = 0;
+  for (unsigned level = 0; level < 256; ++level) {
+    cumulative += histogram[level];
+    lut[level] = uint8_t((cumulative * 255 + area / 2) / area);
+  }
+  return lut;
+}
+}  // namespace
+
+TEST_CASE("Histogram equalization stretches to the full range", "[equalize]") {
+  // Levels 100 to 131, twice as many of the even ones
+  Mat<uint8_t> image({ 24, 32, 1 }, [](unsigned i) -> uint8_t {
+    const unsigned x = i % 32;
+    return uint8_t(100 + (i / 32 % 3 == 0 ? x & ~1u : x));
+  });
+  const auto output = equalizeHistogram(image);
+
+  std::array<unsigned, 256> histogram{};
+  for (auto it = image.cbegin(); it != image.cend(); ++it) {
+    ++histogram[*it];
+  }
+  const unsigned darkest = histogram[100], total = 24 * 32;
+  for (unsigned y = 0; y < 24; ++y) {
+    for (unsigned x = 0; x < 32; ++x) {
+      const unsigned level = image[y][x][0];
+      unsigned cumulative = 0;
+      for (unsigned i = 0; i <= level; ++i) {
+        cumulative += histogram[i];
+      }
+      const unsigned expected =
+          ((cumulative - darkest) * 255 + (total - darkest) / 2) /
+          (total - darkest);
+      REQUIRE(unsigned(output[y][x][0]) == expected);
+    }
+  }
+  REQUIRE(*std::min_element(output.cbegin(), output.cend()) == 0);
+  REQUIRE(*std::max_element(output.cbegin(), output.cend()) == 255);
+}
+
+TEST_CASE("Histogram equalization of a flat image", "[equalize]") {
+  Mat<uint8_t> image({ 5, 7, 1 }, [](unsigned) -> uint8_t { return 77; });
+  const auto output = equalizeHistogram(image);
+  REQUIRE(std::all_of(output.cbegin(), output.cend(),
+                      [](uint8_t value) { return value == 77; }));
+}
+
+TEST_CASE("CLAHE uses one table up to the tile centers", "[equalize]") {
+  const auto image = noise(63, 90);
+  ClaheOptions options;
+  options.tilesY = 3;
+  options.tilesX = 3;
+  options.clipLimit = 1.5;
+  const auto output = clahe(image, options);
+  // 21 x 30 tiles, centered on rows 10, 31, 52 and columns 14.5, 44.5, 74.5
+  for (unsigned ty = 0; ty < 3; ++ty) {
+    const unsigned top = ty * 21, y = top + 10;
+    const auto first = bruteForceTileLut(image, top, top + 21, 0, 30, 1.5);
+    const auto last = bruteForceTileLut(image, top, top + 21, 60, 90, 1.5);
+    for (const unsigned x : { 0, 14 }) {
+      REQUIRE(output[y][x][0] == first[image[y][x][0]]);
+    }
+    for (const unsigned x : { 75, 89 }) {
+      REQUIRE(output[y][x][0] == last[image[y][x][0]]);
+    }
+  }
+}
+
+TEST_CASE("CLAHE with one tile and no clipping equalizes", "[equalize]") {
+  const auto image = noise(20, 30);
+  ClaheOptions options;
+  options.tilesY = 1;
+  options.tilesX = 1;
+  options.clipLimit = 0;
+  const auto output = clahe(image, options);
+  const auto lut = bruteForceTileLut(image, 0, 20, 0, 30, 1e9);
+  for (unsigned y = 0; y < 20; ++y) {
+    for (unsigned x = 0; x < 30; ++x) {
+      REQUIRE(output[y][x][0] == lut[image[y][x][0]]);
+    }
+  }
+}
+
+TEST_CASE("CLAHE adapts the contrast to each region", "[equalize]") {
+  // Dark left half, bright right half, identical texture
+  Mat<uint8_t> image({ 64, 128, 1 }, [](unsigned i) -> uint8_t {
+    const unsigned x = i % 128;
+    return uint8_t((x < 64 ? 40 : 160) + ((i * 2654435761u) >> 29));
+  });
+  ClaheOptions options;
+  options.tilesY = 2;
+  options.tilesX = 2;
+  options.clipLimit = 40;
+  const auto output = clahe(image, options);
+  // A flat image stays flat however the tables blend
+  Mat<uint8_t> flat({ 64, 128, 1 }, [](unsigned) -> uint8_t { return 9; });
+  const auto flatOutput = clahe(flat);
+  const uint8_t level = flatOutput[0][0][0];
+  REQUIRE(std::all_of(flatOutput.cbegin(), flatOutput.cend(),
+                      [&](uint8_t value) { return value == level; }));
+  // Both halves are stretched to similar contrast
+  unsigned darkMax = 0, brightMin = 255;
+  for (unsigned y = 0; y < 64; ++y) {
+    for (unsigned x = 0; x < 16; ++x) {
+      darkMax = std::max<unsigned>(darkMax, output[y][x][0]);
+      brightMin = std::min<unsigned>(brightMin, output[y][127 - x][0]);
+    }
+  }
+  REQUIRE(darkMax > 150);
+  REQUIRE(brightMin < 100);
+}
+
+TEST_CASE("CLAHE rejects bad inputs", "[equalize]") {
+  ClaheOptions options;
+  options.tilesX = 11;
+  REQUIRE_THROWS_AS(clahe(noise(20, 10), options), std::invalid_argument);
+  options.tilesX = 0;
+  REQUIRE_THROWS_AS(clahe(noise(20, 10), options), std::invalid_argument);
+  REQUIRE_THROWS_AS(clahe(Mat<uint8_t>({ 20, 20, 3 })), std::invalid_argument);
+  REQUIRE_THROWS_AS(equalizeHistogram(Mat<uint8_t>({ 2, 2, 2 })),
+                    std::invalid_argument);
+}
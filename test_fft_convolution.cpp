@@ -0,0 +1,111 @@
+#include <cmath>
+
+#include "catch.hpp"
+#include "convolute.hpp"
+#include "fft_convolution.hpp"
+#include "gaussian.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+Mat<double> randomKernel(unsigned rows, unsigned cols) {
+  return Mat<double>({ rows, cols }, [](unsigned i) -> double {
+    return std::sin(i * 1.7) * 0.1;
+  });
+}
+
+template <typename T>
+double maxDifference(const Mat<T>& a, const Mat<T>& b) {
+  REQUIRE(a.shape() == b.shape());
+  double worst = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    worst = std::max(worst, std::abs(double(a.data()[i]) - b.data()[i]));
+  }
+  return worst;
+}
+}  // namespace
+
+TEST_CASE("FFT convolution matches direct convolution", "[fft]") {
+  const auto image = noise(45, 70, 3);
+  for (auto [rows, cols] : { std::pair{ 3u, 3u }, std::pair{ 11u, 11u },
+                             std::pair{ 5u, 9u }, std::pair{ 1u, 25u },
+                             std::pair{ 17u, 3u } }) {
+    const auto kernel = randomKernel(rows, cols);
+    const auto direct = directConvolute<uint8_t, double>(image, kernel);
+    const auto viaFft = fftConvolute<uint8_t, double>(image, kernel);
+    REQUIRE(maxDifference(direct, viaFft) < 1e-9);
+  }
+}
+
+TEST_CASE("FFT convolution keeps exact integer results", "[fft]") {
+  const auto image = noise(30, 40, 1);
+  // Averages of two pixels, exact in binary; half of them are integers
+  Mat<double> pair({ 11, 11 });
+  pair[0][0] = 0.5;
+  pair[10][3] = 0.5;
+  const auto direct = directConvolute(image, pair);
+  const auto viaFft = fftConvolute(image, pair);
+  REQUIRE(maxDifference(direct, viaFft) == 0);
+}
+
+TEST_CASE("Kernels larger than the image mirror repeatedly", "[fft]") {
+  const auto image = noise(6, 9, 1);
+  const auto kernel = randomKernel(13, 13);
+  const auto viaFft = fftConvolute<uint8_t, double>(image, kernel);
+  for (int y = 0; y < 6; ++y) {
+    for (int x = 0; x < 9; ++x) {
+      double sum = 0;
+      for (int i = 0; i < 13; ++i) {
+        for (int j = 0; j < 13; ++j) {
+          // Reflection without repeating the edge, period 2 (n - 1)
+          const auto reflect = [](int index, int end) {
+            index = std::abs(index) % (2 * (end - 1));
+            return index < end ? index : 2 * (end - 1) - index;
+          };
+          sum += image[reflect(y + i - 6, 6)][reflect(x + j - 6, 9)][0] *
+                 kernel[i][j];
+        }
+      }
+      REQUIRE(viaFft[y][x][0] == Approx(sum).margin(1e-9));
+    }
+  }
+}
+
+TEST_CASE("A filter bank equals one convolution per kernel", "[fft]") {
+  const auto image = noise(50, 37, 1);
+  const std::vector<Mat<double>> bank = { randomKernel(5, 5),
+                                          randomKernel(15, 15),
+                                          randomKernel(3, 7) };
+  const auto responses = convoluteBank<uint8_t, double>(image, bank);
+  REQUIRE(responses.size() == bank.size());
+  for (size_t k = 0; k < bank.size(); ++k) {
+    const auto direct = directConvolute<uint8_t, double>(image, bank[k]);
+    REQUIRE(maxDifference(responses[k], direct) < 1e-9);
+  }
+}
+
+TEST_CASE("convolute() switches to FFTs for large kernels", "[fft]") {
+  const auto image = noise(40, 40, 1);
+  const auto kernel = randomKernel(11, 11);
+  REQUIRE(kernel.size() >= fft::MIN_TAPS);
+  const auto result = convolute<uint8_t, double>(image, kernel);
+  REQUIRE(maxDifference(result, directConvolute<uint8_t, double>(
+                                    image, kernel)) < 1e-9);
+}
+
+TEST_CASE("gaussian2nd gives the same image through FFTs", "[fft]") {
+  // gaussian2nd()'s 7x7 Laplacian of Gaussian, past fft::MIN_TAPS
+  static_assert(7 * 7 >= fft::MIN_TAPS);
+  const Mat<double> kernel({ 7, 7 }, [](unsigned i) -> double {
+    const double x = i % 7 - 3.0, y = i / 7 - 3.0;
+    const double r = (x * x + y * y) / 2;
+    return -1 / M_PI * (1 - r) * std::exp(-r);
+  });
+  for (unsigned channels : { 1u, 3u }) {
+    const auto image = noise(61, 47, channels);
+    const auto direct = directConvolute<uint8_t, double>(image, kernel);
+    REQUIRE(maxDifference(direct, convolute<uint8_t, double>(image, kernel)) <
+            1e-9);
+    REQUIRE(equal(gaussian2nd(image),
+                  normalizeTo<uint8_t>(direct, 0, 255, true)));
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+#include "mat.hpp"
+
+// Fixtures shared by the filter tests.
+
+// Deterministic, roughly uniform samples: the top byte of a multiplicative
+// hash of each element's index.
+inline Mat<uint8_t> noise(unsigned height,
+                          unsigned width,
+                          unsigned channels = 1) {
+  return Mat<uint8_t>({ height, width, channels }, [](unsigned i) -> uint8_t {
+    return (i * 2654435761u) >> 24;
+  });
+}
+
+// noise() with the hash mixed further. Plain noise() is quasi-periodic,
+// so its patches nearly repeat elsewhere in the image; these do not.
+inline Mat<uint8_t> mixedNoise(unsigned height,
+                               unsigned width,
+                               unsigned channels = 1) {
+  return Mat<uint8_t>({ height, width, channels }, [](unsigned i) -> uint8_t {
+    uint32_t x = i * 2654435761u;
+    x ^= x >> 15;
+    return (x * 2246822519u) >> 24;
+  });
+}
+
+// Same shape and elements; strided Mats are compared through dense copies.
+template <typename Element>
+bool equal(const Mat<Element>& a, const Mat<Element>& b) {
+  if (a.shape() != b.shape()) {
+    return false;
+  }
+  if (!a.isContiguous() || !b.isContiguous()) {
+    return equal(Mat<Element>(a), Mat<Element>(b));
+  }
+  return std::equal(a.cbegin(), a.cend(), b.cbegin());
+}
@@ -0,0 +1,57 @@
+#include <cmath>
+#include <random>
+
+#include "catch.hpp"
+#include "grayscale.hpp"
+
+namespace {
+Mat<uint8_t> randomImage(unsigned height, unsigned width, unsigned channels) {
+  std::mt19937 rng(7);
+  return Mat<uint8_t>({ height, width, channels },
+                      [&rng](unsigned) -> uint8_t { return rng() & 0xFF; });
+}
+}  // namespace
+
+TEST_CASE("Average grayscale matches the rounded mean", "[grayscale]") {
+  // 37 columns leaves a scalar tail after the vector kernels
+  for (unsigned channels : { 3u, 4u }) {
+    const auto image = randomImage(5, 37, channels);
+    const auto gray = grayscale(image);
+    REQUIRE(gray.dimension(2) == 1);
+    for (unsigned i = 0; i < gray.size(); ++i) {
+      const auto* p = image.data() + i * channels;
+      REQUIRE(gray(i) == std::round((p[0] + p[1] + p[2]) / 3.0));
+    }
+  }
+}
+
+TEST_CASE("Weighted grayscale is within one level of BT.601/709",
+          "[grayscale]") {
+  const auto image = randomImage(3, 41, 3);
+  const auto bt601 = grayscale(image, GrayscaleWeights::BT601);
+  const auto bt709 = grayscale(image, GrayscaleWeights::BT709);
+  for (unsigned i = 0; i < bt601.size(); ++i) {
+    const auto* p = image.data() + i * 3;
+    REQUIRE(std::abs(bt601(i) -
+                     (0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2])) <= 1);
+    REQUIRE(std::abs(bt709(i) -
+                     (0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2])) <= 1);
+  }
+
+  const auto single = randomImage(2, 9, 1);
+  const auto same = grayscale(single, GrayscaleWeights::BT709);
+  REQUIRE(std::equal(same.cbegin(), same.cend(), single.cbegin()));
+}
+
+TEST_CASE("Gray + alpha keeps the gray channel", "[grayscale]") {
+  const auto image = randomImage(4, 23, 2);
+  for (const auto weights : { GrayscaleWeights::AVERAGE,
+                              GrayscaleWeights::BT601,
+                              GrayscaleWeights::BT709 }) {
+    const auto gray = grayscale(image, weights);
+    REQUIRE(gray.dimension(2) == 1);
+    for (unsigned i = 0; i < gray.size(); ++i) {
+      REQUIRE(gray(i) == image(i * 2));
+    }
+  }
+}
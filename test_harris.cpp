@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "catch.hpp"
+#include "harris.hpp"
+#include "img.hpp"
+#include "sobel.hpp"
+
+namespace {
+Mat<uint8_t> square(unsigned height, unsigned width) {
+  return Mat<uint8_t>({ height, width, 1 }, [=](unsigned i) -> uint8_t {
+    const unsigned y = i / width, x = i % width;
+    const bool inside = y >= 10 && y < 30 && x >= 12 && x < 40;
+    return uint8_t((inside ? 200 : 40) + ((i * 2654435761u) >> 29));
+  });
+}
+
+// The response and the size of the terms it cancels down from
+std::pair<double, double> bruteForceResponse(const Mat<uint8_t>& image,
+                                             unsigned y,
+                                             unsigned x,
+                                             const CornerOptions& options) {
+  const auto [gradientX, gradientY] = sobelXYGradients(image);
+  const int height = img::height(image), width = img::width(image);
+  const int radius = options.radius;
+  double xx = 0, xy = 0, yy = 0;
+  for (int dy = -radius; dy <= radius; ++dy) {
+    for (int dx = -radius; dx <= radius; ++dx) {
+      const int row = mirror(int(y) + dy, height);
+      const int column = mirror(int(x) + dx, width);
+      const double gx = gradientX[row][column][0];
+      const double gy = gradientY[row][column][0];
+      xx += gx * gx;
+      xy += gx * gy;
+      yy += gy * gy;
+    }
+  }
+  const double area = (2 * radius + 1) * (2 * radius + 1);
+  xx /= area;
+  xy /= area;
+  yy /= area;
+  const double det = xx * yy - xy * xy, trace = xx + yy;
+  switch (options.score) {
+    case CornerScore::HARRIS:
+      return { det - options.k * trace * trace, trace * trace };
+    case CornerScore::SHI_TOMASI:
+      return { trace / 2 - std::sqrt((xx - yy) * (xx - yy) / 4 + xy * xy),
+               trace };
+    case CornerScore::NOBLE:
+      return { det / (trace + 1e-6), trace };
+  }
+  return { 0, 0 };
+}
+}  // namespace
+
+TEST_CASE("Corner responses match the definitions", "[corner]") {
+  const auto image = square(40, 50);
+  for (const auto score : { CornerScore::HARRIS, CornerScore::SHI_TOMASI,
+                            CornerScore::NOBLE }) {
+    for (const unsigned radius : { 1, 2, 4 }) {
+      CornerOptions options;
+      options.score = score;
+      options.radius = radius;
+      options.k = 0.06f;
+      const auto response = cornerResponse(image, options);
+      REQUIRE(img::height(response) == 40);
+      REQUIRE(img::width(response) == 50);
+      for (const unsigned y : { 0, 1, 10, 11, 29, 39 }) {
+        for (const unsigned x : { 0, 2, 12, 25, 40, 49 }) {
+          const auto [expected, terms] =
+              bruteForceResponse(image, y, x, options);
+          REQUIRE(response[y][x][0] ==
+                  Approx(expected).epsilon(1e-4).margin(terms * 1e-6));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Corners outscore edges and flat regions", "[corner]") {
+  const auto image = square(40, 50);
+  for (const auto score : { CornerScore::HARRIS, CornerScore::SHI_TOMASI,
+                            CornerScore::NOBLE }) {
+    CornerOptions options;
+    options.score = score;
+    const auto response = cornerResponse(image, options);
+    const float corner = response[10][12][0];
+    REQUIRE(corner > 0);
+    REQUIRE(response[10][26][0] < corner / 4);
+    REQUIRE(response[20][26][0] < corner / 100);
+  }
+
+  // Harris scores straight edges below zero
+  const auto harrisResponse = cornerResponse(image);
+  REQUIRE(harrisResponse[20][12][0] < 0);
+}
+
+TEST_CASE("Flat images have no corner response", "[corner]") {
+  Mat<uint8_t> flat({ 8, 8, 1 }, [](unsigned) -> uint8_t { return 90; });
+  CornerOptions options;
+  options.score = CornerScore::NOBLE;
+  const auto response = cornerResponse(flat, options);
+  REQUIRE(std::all_of(response.cbegin(), response.cend(),
+                      [](float value) { return value == 0; }));
+}
+
+TEST_CASE("Corner response rejects bad inputs", "[corner]") {
+  CornerOptions options;
+  options.radius = 5;
+  REQUIRE_THROWS_AS(cornerResponse(square(5, 20), options),
+                    std::invalid_argument);
+  REQUIRE_THROWS_AS(cornerResponse(Mat<uint8_t>({ 9, 9, 3 })),
+                    std::invalid_argument);
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "catch.hpp"
+#include "hough.hpp"
+#include "sobel.hpp"
+
+namespace {
+// Edge map with a horizontal line at y = 20, a vertical one at x = 30 and
+// a diagonal x + y = 60
+Mat<uint8_t> threeLines() {
+  Mat<uint8_t> edges({ 64, 80, 1 });
+  for (unsigned x = 0; x < 80; ++x) {
+    edges[20][x][0] = 255;
+  }
+  for (unsigned y = 0; y < 64; ++y) {
+    edges[y][30][0] = 255;
+    if (y <= 60) {
+      edges[y][60 - y][0] = 255;
+    }
+  }
+  return edges;
+}
+
+bool hasLine(const std::vector<HoughLine>& lines, double rho, double theta) {
+  return std::any_of(lines.begin(), lines.end(), [&](const HoughLine& line) {
+    return std::abs(line.rho - rho) <= 1 &&
+           std::abs(line.theta - theta) <= M_PI / 180 + 1e-9;
+  });
+}
+}  // namespace
+
+TEST_CASE("Hough finds straight lines", "[hough]") {
+  HoughOptions options;
+  options.threshold = 40;
+  const auto lines = houghLines(threeLines(), options);
+  REQUIRE(lines.size() == 3);
+  REQUIRE(hasLine(lines, 20, M_PI / 2));
+  REQUIRE(hasLine(lines, 30, 0));
+  REQUIRE(hasLine(lines, 60 / std::sqrt(2.0), M_PI / 4));
+  // Strongest first: the horizontal line has the most pixels
+  REQUIRE(lines[0].votes == 80);
+  REQUIRE(std::is_sorted(lines.begin(), lines.end(),
+                         [](const HoughLine& a, const HoughLine& b) {
+                           return a.votes > b.votes;
+                         }));
+
+  options.maxLines = 1;
+  REQUIRE(houghLines(threeLines(), options).size() == 1);
+}
+
+TEST_CASE("Gradient-restricted voting finds the same lines", "[hough]") {
+  // Filled shapes, so the gradients across the edges are meaningful: a
+  // bright band below y = 20 and a bright half right of x = 50
+  Mat<uint8_t> image({ 64, 80, 1 }, [](unsigned i) -> uint8_t {
+    const unsigned y = i / 80, x = i % 80;
+    return (y >= 20 ? 100 : 0) + (x >= 50 ? 100 : 0);
+  });
+  Mat<uint8_t> edges({ 64, 80, 1 });
+  for (unsigned y = 0; y < 64; ++y) {
+    for (unsigned x = 0; x < 80; ++x) {
+      edges[y][x][0] = y == 20 || x == 50 ? 255 : 0;
+    }
+  }
+  const auto gradients = sobelXYGradients(image);
+
+  HoughOptions options;
+  options.threshold = 40;
+  const auto full = houghLines(edges, options);
+  const auto restricted = houghLines(edges, gradients, options);
+  REQUIRE(hasLine(restricted, 20, M_PI / 2));
+  REQUIRE(hasLine(restricted, 50, 0));
+  REQUIRE(restricted.size() == full.size());
+  for (size_t i = 0; i < full.size(); ++i) {
+    REQUIRE(restricted[i].rho == full[i].rho);
+    REQUIRE(restricted[i].theta == full[i].theta);
+  }
+}
+
+TEST_CASE("Hough suppression wraps around theta = 0", "[hough]") {
+  // A line tilted half a degree past vertical: its votes split between
+  // theta = 0 and theta = 179 degrees, where rho has the opposite sign
+  Mat<uint8_t> edges({ 200, 80, 1 });
+  const double tilt = M_PI / 360;
+  for (unsigned y = 0; y < 200; ++y) {
+    const double x = (30 + y * std::sin(tilt)) / std::cos(tilt);
+    edges[y][unsigned(std::lround(x))][0] = 255;
+  }
+  HoughOptions options;
+  options.threshold = 60;
+  const auto lines = houghLines(edges, options);
+  REQUIRE(lines.size() == 1);
+  REQUIRE((hasLine(lines, 30, 0) || hasLine(lines, -30, M_PI - M_PI / 180)));
+}
+
+TEST_CASE("Hough reads strided edge maps", "[hough]") {
+  // Every other column of a frame twice as wide
+  const auto dense = threeLines();
+  std::vector<uint8_t> frame(64 * 160);
+  for (unsigned y = 0; y < 64; ++y) {
+    for (unsigned x = 0; x < 80; ++x) {
+      frame[y * 160 + 2 * x] = dense[y][x][0];
+      frame[y * 160 + 2 * x + 1] = 255;
+    }
+  }
+  const auto view =
+      Mat<uint8_t>::borrow(frame.data(), { 64, 80, 1 }, { 160, 2, 1 });
+  HoughOptions options;
+  options.threshold = 40;
+  const auto expected = houghLines(dense, options);
+  const auto lines = houghLines(view, options);
+  REQUIRE(lines.size() == expected.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    REQUIRE(lines[i].rho == expected[i].rho);
+    REQUIRE(lines[i].theta == expected[i].theta);
+    REQUIRE(lines[i].votes == expected[i].votes);
+  }
+}
+
+TEST_CASE("Hough rejects mismatched inputs", "[hough]") {
+  REQUIRE_THROWS_AS(houghLines(Mat<uint8_t>({ 4, 4, 3 })),
+                    std::invalid_argument);
+  const auto gradients = sobelXYGradients(Mat<uint8_t>({ 5, 4, 1 }));
+  REQUIRE_THROWS_AS(houghLines(Mat<uint8_t>({ 4, 4, 1 }), gradients),
+                    std::invalid_argument);
+  HoughOptions options;
+  options.thetaBins = 0;
+  REQUIRE_THROWS_AS(houghLines(Mat<uint8_t>({ 4, 4, 1 }), options),
+                    std::invalid_argument);
+}
@@ -0,0 +1,32 @@
+#include "catch.hpp"
+#include "integral_image.hpp"
+
+TEST_CASE("Integral image window sums", "[integral]") {
+  Mat<uint8_t> image({ 3, 4, 1 }, { 1, 2, 3, 4,  //
+                                    5, 6, 7, 8,  //
+                                    9, 10, 11, 12 });
+  const IntegralImage table(image, true);
+  REQUIRE(table.hasSquares());
+  REQUIRE(table.getSum(0, 0, 0, 0) == 1);
+  REQUIRE(table.getSum(0, 0, 3, 2) == 78);
+  REQUIRE(table.getSum(1, 1, 2, 2) == 6 + 7 + 10 + 11);
+  REQUIRE(table.getSum(3, 0, 3, 2) == 4 + 8 + 12);
+  REQUIRE(table.getSquaredSum(1, 1, 2, 2) == 36 + 49 + 100 + 121);
+
+  // The 2D view constructor builds the same sums
+  MatView2D<uint8_t> view(image);
+  const IntegralImage fromView(view);
+  REQUIRE_FALSE(fromView.hasSquares());
+  for (unsigned y = 0; y < 3; ++y) {
+    for (unsigned x = 0; x < 4; ++x) {
+      REQUIRE(fromView.getSum(0, 0, x, y) == table.getSum(0, 0, x, y));
+    }
+  }
+}
+
+TEST_CASE("Integral image squares do not overflow", "[integral]") {
+  Mat<uint8_t> image({ 300, 300, 1 },
+                     [](unsigned) -> uint8_t { return 255; });
+  const IntegralImage table(image, true);
+  REQUIRE(table.getSquaredSum(0, 0, 299, 299) == 255ll * 255 * 300 * 300);
+}
@@ -0,0 +1,118 @@
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "labeling.hpp"
+
+namespace {
+// Sparse random blobs: about one pixel in three is set
+Mat<uint8_t> blobs(unsigned height, unsigned width) {
+  return Mat<uint8_t>({ height, width, 1 }, [](unsigned i) -> uint8_t {
+    return ((i * 2654435761u) >> 24) < 90 ? 255 : 0;
+  });
+}
+
+// Flood fill from every unlabeled foreground pixel in raster order
+Mat<uint32_t> floodFill(const Mat<uint8_t>& mask, bool eight) {
+  const int height = img::height(mask), width = img::width(mask);
+  Mat<uint32_t> labels({ unsigned(height), unsigned(width), 1 });
+  uint32_t count = 0;
+  std::vector<std::pair<int, int>> stack;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      if (!mask[y][x][0] || labels[y][x][0]) {
+        continue;
+      }
+      labels[y][x][0] = ++count;
+      stack.push_back({ y, x });
+      while (!stack.empty()) {
+        const auto [cy, cx] = stack.back();
+        stack.pop_back();
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            const int ny = cy + dy, nx = cx + dx;
+            if ((!eight && dy && dx) || ny < 0 || ny >= height || nx < 0 ||
+                nx >= width || !mask[ny][nx][0] || labels[ny][nx][0]) {
+              continue;
+            }
+            labels[ny][nx][0] = count;
+            stack.push_back({ ny, nx });
+          }
+        }
+      }
+    }
+  }
+  return labels;
+}
+}  // namespace
+
+TEST_CASE("Labels match a flood fill", "[labeling]") {
+  // 700 columns gives strips of 93 rows, so strip boundaries get merged
+  const auto mask = blobs(300, 700);
+  for (auto connectivity : { Connectivity::FOUR, Connectivity::EIGHT }) {
+    const auto expected =
+        floodFill(mask, connectivity == Connectivity::EIGHT);
+    const auto components = labelComponents(mask, connectivity);
+    REQUIRE(components.labels.shape() == expected.shape());
+    REQUIRE(std::equal(components.labels.cbegin(), components.labels.cend(),
+                       expected.cbegin()));
+    REQUIRE(components.count ==
+            *std::max_element(expected.cbegin(), expected.cend()));
+    REQUIRE(components.stats.empty());
+  }
+}
+
+TEST_CASE("Diagonal neighbours join only with 8-connectivity", "[labeling]") {
+  Mat<uint8_t> mask({ 3, 3, 1 }, { 1, 0, 0, 0, 1, 0, 0, 0, 1 });
+  REQUIRE(labelComponents(mask, Connectivity::EIGHT).count == 1);
+  REQUIRE(labelComponents(mask, Connectivity::FOUR).count == 3);
+}
+
+TEST_CASE("Component stats", "[labeling]") {
+  // A U shape whose arms only meet in the last row, and a lone pixel
+  Mat<uint8_t> mask({ 4, 6, 1 }, { 1, 0, 1, 0, 0, 0,  //
+                                   1, 0, 1, 0, 0, 1,  //
+                                   1, 0, 1, 0, 0, 0,  //
+                                   1, 1, 1, 0, 0, 0 });
+  const auto components = labelComponents(mask, Connectivity::FOUR, true);
+  REQUIRE(components.count == 2);
+  REQUIRE(components.stats.size() == 2);
+
+  const auto& u = components.stats[0];
+  REQUIRE(u.area == 9);
+  REQUIRE(u.top == 0);
+  REQUIRE(u.left == 0);
+  REQUIRE(u.bottom == 4);
+  REQUIRE(u.right == 3);
+  REQUIRE(u.centroidX == Approx(1.0));
+  REQUIRE(u.centroidY == Approx(15.0 / 9));
+
+  const auto& dot = components.stats[1];
+  REQUIRE(dot.area == 1);
+  REQUIRE(dot.top == 1);
+  REQUIRE(dot.left == 5);
+  REQUIRE(dot.bottom == 2);
+  REQUIRE(dot.right == 6);
+  REQUIRE(dot.centroidY == Approx(1.0));
+  REQUIRE(dot.centroidX == Approx(5.0));
+  REQUIRE(components.labels[1][5][0] == 2);
+}
+
+TEST_CASE("Labeling handles empty and full masks", "[labeling]") {
+  const auto empty = labelComponents(Mat<uint8_t>({ 5, 7, 1 }));
+  REQUIRE(empty.count == 0);
+  REQUIRE(std::all_of(empty.labels.cbegin(), empty.labels.cend(),
+                      [](uint32_t label) { return label == 0; }));
+
+  Mat<uint8_t> full({ 300, 700, 1 }, [](unsigned) -> uint8_t { return 1; });
+  const auto one = labelComponents(full, Connectivity::FOUR, true);
+  REQUIRE(one.count == 1);
+  REQUIRE(one.stats[0].area == 300 * 700);
+}
+
+TEST_CASE("Labeling rejects multi-channel masks", "[labeling]") {
+  REQUIRE_THROWS_AS(labelComponents(Mat<uint8_t>({ 2, 2, 3 })),
+                    std::invalid_argument);
+}
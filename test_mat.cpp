@@ -1,6 +1,13 @@
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
 #include "catch.hpp"
+#include "convolute.hpp"
 #include "img.hpp"
 #include "mat.hpp"
+#include "test_fixtures.hpp"
 
 TEST_CASE("Element get/set works", "[Mat]") {
   Mat<int> m({ 7 }, { 1, 2, 3, 4, 5, 6, 7 });
@@ -41,7 +48,7 @@ TEST_CASE("Addition works", "[Mat]") {
   Mat<int> a({ 2, 2 }, { 1, 2, 3, 4 });
   Mat<int> b({ 2, 2 }, { 4, 3, 2, 1 });
 
-  auto c = a + b;
+  Mat<int> c = a + b;
   REQUIRE(c[0][0] == 5);
   REQUIRE(c[0][1] == 5);
   REQUIRE(c[1][0] == 5);
@@ -52,7 +59,7 @@ TEST_CASE("Subtraction works", "[Mat]") {
   Mat<int> a({ 2, 2 }, { 1, 2, 3, 4 });
   Mat<int> b({ 2, 2 }, { 4, 3, 2, 1 });
 
-  auto c = a - b;
+  Mat<int> c = a - b;
   REQUIRE(c[0][0] == -3);
   REQUIRE(c[0][1] == -1);
   REQUIRE(c[1][0] == 1);
@@ -63,3 +70,257 @@ TEST_CASE("read works", "[Mat]") {
   auto m = img::read("./images/yellow.png");
   REQUIRE(m.dimensions() == 3);
 }
+
+TEST_CASE("Storage is aligned and pooled", "[Mat]") {
+  MatPool& pool = MatPool::global();
+  {
+    Mat<double> warmup({ 31, 17, 3 });
+  }
+  pool.resetStats();
+
+  for (int i = 0; i < 4; ++i) {
+    Mat<double> m({ 31, 17, 3 });
+    REQUIRE(reinterpret_cast<uintptr_t>(m.data()) % MatPool::ALIGNMENT == 0);
+  }
+  const auto stats = pool.stats();
+  REQUIRE(stats.misses == 0);
+  REQUIRE(stats.hits == 4);
+  REQUIRE(stats.highWaterMark >= 31 * 17 * 3 * sizeof(double));
+}
+
+TEST_CASE("Pools can be disabled while in use", "[Mat]") {
+  MatPool pool;
+  std::atomic<bool> done{ false };
+  std::thread worker([&] {
+    while (!done) {
+      void* block = pool.allocate(1000);
+      pool.deallocate(block, 1000);
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    pool.setEnabled(i % 2 == 1);
+  }
+  done = true;
+  worker.join();
+
+  pool.setEnabled(false);
+  const auto stats = pool.stats();
+  REQUIRE(stats.bytesInUse == 0);
+  REQUIRE(stats.bytesCached == 0);
+  void* block = pool.allocate(1000);
+  pool.deallocate(block, 1000);
+  REQUIRE(pool.stats().bytesCached == 0);
+}
+
+TEST_CASE("Pool size classes have bounded slack", "[Mat]") {
+  for (size_t bytes : { 1ul, 64ul, 65ul, 1000ul, 4097ul, 1234567ul }) {
+    const auto blockSize = MatPool::sizeClass(bytes);
+    REQUIRE(blockSize >= bytes);
+    REQUIRE(blockSize % MatPool::ALIGNMENT == 0);
+    REQUIRE(blockSize <= bytes * 5 / 4 + MatPool::ALIGNMENT);
+  }
+}
+
+TEST_CASE("Uninitialized and move-aware construction works", "[Mat]") {
+  auto m = Mat<int>::uninitialized({ 3, 4 });
+  REQUIRE(m.size() == 12);
+  REQUIRE(m.dimension(1) == 4);
+
+  Mat<int>::storage_t elements = { 1, 2, 3, 4 };
+  const int* storage = elements.data();
+  Mat<int> a({ 2, 2 }, std::move(elements));
+  REQUIRE(a.data() == storage);
+
+  Mat<int> b({ 2, 2 }, { 4, 3, 2, 1 });
+  const int* reused = a.data();
+  Mat<int> c = std::move(a) + b - b;
+  REQUIRE(c.data() == reused);
+  REQUIRE(c[1][1] == 4);
+}
+
+TEST_CASE("convertTo saturates and matches scalar conversion", "[Mat]") {
+  // 37 elements exercises both the vector body and the scalar tail
+  Mat<double> d({ 37 }, [](unsigned i) -> double { return i * 10.0 - 60.4; });
+
+  auto u = d.convertTo<uint8_t>();
+  for (unsigned i = 0; i < d.size(); ++i) {
+    REQUIRE(u(i) == saturateCast<uint8_t>(d(i)));
+  }
+  REQUIRE(u(0) == 0);
+  REQUIRE(u(7) == 10);
+  REQUIRE(u(36) == 255);
+
+  auto f = u.convertTo<float>(0.5, 1);
+  for (unsigned i = 0; i < u.size(); ++i) {
+    REQUIRE(f(i) == u(i) * 0.5f + 1);
+  }
+  auto back = f.convertTo<uint8_t>(2, -2);
+  for (unsigned i = 0; i < u.size(); ++i) {
+    REQUIRE(back(i) == u(i));
+  }
+
+  auto g = Mat<uint8_t>({ 2, 2 }, { 0, 1, 254, 255 }).clone<double>();
+  REQUIRE(g(3) == 255.0);
+}
+
+TEST_CASE("Arithmetic expressions evaluate lazily in one pass", "[Mat]") {
+  Mat<int> a({ 2, 2 }, { 1, 2, 3, 4 });
+  Mat<int> b({ 2, 2 }, { 4, 3, 2, 1 });
+  Mat<int> c({ 2, 2 }, { 1, 1, 1, 1 });
+
+  Mat<int> d = a + b * 2 - c;
+  REQUIRE(d(0) == 8);
+  REQUIRE(d(3) == 5);
+  REQUIRE(d.dimension(1) == 2);
+
+  Mat<double> e = abs(a - b) * 0.5 + 1;
+  REQUIRE(e(0) == 2.5);
+  REQUIRE(e(1) == 1.5);
+
+  Mat<int> lo = min(a, b);
+  Mat<int> hi = max(a, 3);
+  REQUIRE(lo(0) == 1);
+  REQUIRE(lo(3) == 1);
+  REQUIRE(hi(0) == 3);
+  REQUIRE(hi(3) == 4);
+
+  Mat<uint8_t> mask = a > b;
+  REQUIRE(mask(1) == 0);
+  REQUIRE(mask(2) == 1);
+
+  const int* storage = a.data();
+  a += b;
+  a -= c;
+  a *= 2;
+  REQUIRE(a.data() == storage);
+  REQUIRE(a(0) == 8);
+  REQUIRE(a(3) == 8);
+
+  a = -a;
+  REQUIRE(a(2) == -8);
+}
+
+TEST_CASE("grayscale read works", "[Mat]") {
+  img::ReadOptions options;
+  options.grayscale = true;
+  options.weights = GrayscaleWeights::BT709;
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "cpp-image-processing-grayscale-read.png")
+                        .string();
+  img::write(noise(23, 31, 3), path, PNG_COLOR_TYPE_RGB);
+  auto gray = img::read(path, options);
+  auto color = img::read(path);
+  std::remove(path.c_str());
+  REQUIRE(img::channel(gray) == 1);
+  REQUIRE(img::height(gray) == img::height(color));
+  REQUIRE(img::width(gray) == img::width(color));
+
+  auto reference = grayscale(color, GrayscaleWeights::BT709);
+  for (unsigned i = 0; i < gray.size(); ++i) {
+    REQUIRE(std::abs(gray(i) - reference(i)) <= 1);
+  }
+}
+
+TEST_CASE("Mats wrap external buffers", "[Mat]") {
+  std::vector<int> buffer = { 1, 2, 3, 4, 5, 6 };
+  auto borrowed = Mat<int>::borrow(buffer.data(), { 2, 3 });
+  REQUIRE(borrowed.data() == buffer.data());
+  REQUIRE(borrowed.isContiguous());
+  borrowed[1][2] = 60;
+  REQUIRE(buffer[5] == 60);
+
+  // Copies are owned and leave the buffer alone
+  Mat<int> copy = borrowed;
+  copy[0][0] = 10;
+  REQUIRE(copy.data() != buffer.data());
+  REQUIRE(buffer[0] == 1);
+
+  bool released = false;
+  {
+    auto adopted = Mat<int>::adopt(
+        buffer.data(), { 6 }, [&](int* p) { released = p == buffer.data(); });
+    Mat<int> moved = std::move(adopted);
+    REQUIRE(moved[5] == 60);
+    REQUIRE(!released);
+  }
+  REQUIRE(released);
+}
+
+TEST_CASE("Strided Mats read through accessors and compact on copy", "[Mat]") {
+  // A 2x3 single channel image in rows padded to 5 elements
+  std::vector<uint8_t> frame = { 1, 2, 3, 0, 0, 4, 5, 6, 0, 0 };
+  auto image = Mat<uint8_t>::borrow(frame.data(), { 2, 3, 1 }, { 5, 1, 1 });
+  REQUIRE(!image.isContiguous());
+  REQUIRE(image[1][0][0] == 4);
+  REQUIRE_THROWS(image[2][0][0] == 0);
+
+  const Mat<uint8_t> packed = image;
+  REQUIRE(packed.isContiguous());
+  REQUIRE(std::vector<uint8_t>(packed.cbegin(), packed.cend()) ==
+          std::vector<uint8_t>{ 1, 2, 3, 4, 5, 6 });
+  const auto asDouble = image.convertTo<double>(2);
+  REQUIRE(asDouble(3) == 8);
+
+  const Mat<double> kernal({ 3, 3 }, { 0, 1, 0, 1, 4, 1, 0, 1, 0 });
+  const auto fromView = convolute<uint8_t, double>(image, kernal);
+  const auto fromCopy = convolute<uint8_t, double>(packed, kernal);
+  REQUIRE(std::equal(fromView.cbegin(), fromView.cend(), fromCopy.cbegin()));
+
+  // Row-padded RGB converts without compacting
+  std::vector<uint8_t> rgb = { 30, 60, 90, 0, 3, 6, 9, 0 };
+  auto rgbView = Mat<uint8_t>::borrow(rgb.data(), { 2, 1, 3 }, { 4, 3, 1 });
+  const auto gray = grayscale(rgbView);
+  REQUIRE(gray(0) == 60);
+  REQUIRE(gray(1) == 6);
+}
+
+TEST_CASE("Accessors apply the innermost stride", "[Mat]") {
+  // The green channel of interleaved RGB, as a 2x4 single channel view
+  std::vector<uint8_t> rgb(24);
+  for (unsigned i = 0; i < rgb.size(); ++i) {
+    rgb[i] = i;
+  }
+  auto green = Mat<uint8_t>::borrow(rgb.data() + 1, { 2, 4 }, { 12, 3 });
+  REQUIRE(green[1][2] == 19);
+  REQUIRE(Mat<uint8_t>(green)[1][2] == 19);
+  green[0][3] = 100;
+  REQUIRE(rgb[10] == 100);
+  REQUIRE(rgb[3] == 3);
+
+  const auto& constGreen = green;
+  REQUIRE(constGreen[0][1] == 4);
+}
+
+TEST_CASE("Expressions assign through strides", "[Mat]") {
+  std::vector<int> frame = { 1, 2, 3, -1, 4, 5, 6, -1 };
+  auto view = Mat<int>::borrow(frame.data(), { 2, 3 }, { 4, 1 });
+  const Mat<int> offsets({ 2, 3 }, { 10, 20, 30, 40, 50, 60 });
+  const Mat<int> packed = view;
+  view = packed * 2 + offsets;
+  REQUIRE(view.data() == frame.data());
+  REQUIRE(frame == std::vector<int>{ 12, 24, 36, -1, 48, 60, 72, -1 });
+
+  // Contiguous borrowed Mats are written through as well
+  std::vector<int> dense(6, 0);
+  auto denseView = Mat<int>::borrow(dense.data(), { 2, 3 });
+  denseView = offsets - 1;
+  REQUIRE(dense == std::vector<int>{ 9, 19, 29, 39, 49, 59 });
+
+  // In-place arithmetic on a padded view reads and writes only the view
+  std::vector<uint8_t> padded(24, 0);
+  auto rows = Mat<uint8_t>::borrow(padded.data(), { 2, 4, 1 }, { 12, 3, 1 });
+  rows += 1;
+  rows *= rows + 1;
+  unsigned sum = 0;
+  for (unsigned i = 0; i < padded.size(); ++i) {
+    sum += padded[i];
+    REQUIRE(padded[i] == (i % 3 == 0 ? 2 : 0));
+  }
+  REQUIRE(sum == 16);
+  rows -= Mat<uint8_t>(rows) - rows;
+  REQUIRE(padded[15] == 2);
+
+  // The external buffer cannot take another shape
+  const Mat<int> other({ 3, 2 });
+  REQUIRE_THROWS_AS(view = other + 1, std::invalid_argument);
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "median.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+// Sorts every window, mirroring borders like convolute()
+Mat<uint8_t> bruteForceMedian(const Mat<uint8_t>& image, int radius) {
+  const int height = img::height(image), width = img::width(image);
+  const unsigned channels = img::channel(image);
+  Mat<uint8_t> output({ unsigned(height), unsigned(width), channels });
+  std::vector<uint8_t> window;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (unsigned c = 0; c < channels; ++c) {
+        window.clear();
+        for (int dy = -radius; dy <= radius; ++dy) {
+          for (int dx = -radius; dx <= radius; ++dx) {
+            window.push_back(
+                image[mirror(y + dy, height)][mirror(x + dx, width)][c]);
+          }
+        }
+        std::nth_element(window.begin(), window.begin() + window.size() / 2,
+                         window.end());
+        output[y][x][c] = window[window.size() / 2];
+      }
+    }
+  }
+  return output;
+}
+}  // namespace
+
+TEST_CASE("Median matches sorting every window", "[median]") {
+  for (unsigned channels : { 1u, 3u, 4u }) {
+    // Wide enough for the vector loops plus a scalar tail
+    const auto image = noise(23, 37, channels);
+    for (unsigned radius : { 0u, 1u, 2u, 3u, 7u }) {
+      const auto expected = bruteForceMedian(image, radius);
+      const auto actual = median(image, radius);
+      REQUIRE(equal(actual, expected));
+    }
+  }
+}
+
+TEST_CASE("Median strips agree with a single pass", "[median]") {
+  // Tall enough to be split into several row strips
+  const auto image = noise(300, 19, 1);
+  for (unsigned radius : { 1u, 4u, 18u }) {
+    const auto expected = bruteForceMedian(image, radius);
+    const auto actual = median(image, radius);
+    REQUIRE(equal(actual, expected));
+  }
+}
+
+TEST_CASE("Median removes salt and pepper noise", "[median]") {
+  Mat<uint8_t> image({ 16, 16, 1 }, [](unsigned) -> uint8_t { return 100; });
+  image[3][4][0] = 255;
+  image[9][9][0] = 0;
+  image[12][2][0] = 255;
+  for (unsigned radius : { 1u, 2u, 3u }) {
+    const auto filtered = median(image, radius);
+    REQUIRE(std::all_of(filtered.cbegin(), filtered.cend(),
+                        [](uint8_t v) { return v == 100; }));
+  }
+}
+
+TEST_CASE("Median reads strided views", "[median]") {
+  const auto image = noise(20, 30, 3);
+  const auto view = Mat<uint8_t>::borrow(const_cast<uint8_t*>(image.data()),
+                                         { 10, 15, 3 }, { 180, 6, 1 });
+  const auto expected = bruteForceMedian(Mat<uint8_t>(view), 2);
+  const auto actual = median(view, 2);
+  REQUIRE(equal(actual, expected));
+}
+
+TEST_CASE("Median rejects radii the image cannot mirror", "[median]") {
+  const auto image = noise(5, 40, 1);
+  REQUIRE_NOTHROW(median(image, 4));
+  REQUIRE_THROWS_AS(median(image, 5), std::invalid_argument);
+  REQUIRE_THROWS_AS(median(noise(300, 300, 1), 128), std::invalid_argument);
+}
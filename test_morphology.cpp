@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "morphology.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+// Extremum over the window, skipping pixels outside the image
+Mat<uint8_t> bruteForce(const Mat<uint8_t>& image,
+                        StructuringElement element,
+                        bool dilation) {
+  const int height = img::height(image), width = img::width(image);
+  const unsigned channels = img::channel(image);
+  const int h = element.height, w = element.width;
+  const int top = dilation ? h / 2 : (h - 1) / 2;
+  const int left = dilation ? w / 2 : (w - 1) / 2;
+  Mat<uint8_t> output({ unsigned(height), unsigned(width), channels });
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (unsigned c = 0; c < channels; ++c) {
+        uint8_t value = dilation ? 0 : 255;
+        for (int yy = y - top; yy < y - top + h; ++yy) {
+          for (int xx = x - left; xx < x - left + w; ++xx) {
+            if (yy >= 0 && yy < height && xx >= 0 && xx < width) {
+              const uint8_t v = image[yy][xx][c];
+              value = dilation ? std::max(value, v) : std::min(value, v);
+            }
+          }
+        }
+        output[y][x][c] = value;
+      }
+    }
+  }
+  return output;
+}
+}  // namespace
+
+TEST_CASE("Dilation and erosion match the window extremum", "[morphology]") {
+  // Sizes on both sides of the direct/running-extremum switch, odd and even
+  const StructuringElement elements[] = {
+    StructuringElement::rect(1, 1),   StructuringElement::rect(3, 3),
+    StructuringElement::rect(2, 4),   StructuringElement::horizontal(5),
+    StructuringElement::vertical(6),  StructuringElement::rect(11, 13),
+    StructuringElement::rect(4, 20),  StructuringElement::rect(7, 30),
+    StructuringElement::horizontal(40),
+  };
+  for (unsigned channels : { 1u, 3u }) {
+    const auto image = noise(29, 35, channels);
+    for (const auto& element : elements) {
+      REQUIRE(equal(dilate(image, element), bruteForce(image, element, true)));
+      REQUIRE(equal(erode(image, element), bruteForce(image, element, false)));
+    }
+  }
+}
+
+TEST_CASE("Column passes cover strips wider than one block", "[morphology]") {
+  const auto image = noise(12, 700, 1);
+  const auto element = StructuringElement::rect(5, 3);
+  REQUIRE(equal(dilate(image, element), bruteForce(image, element, true)));
+}
+
+TEST_CASE("Opening and closing compose erosion and dilation",
+          "[morphology]") {
+  const auto image = noise(31, 27, 1);
+  for (const auto& element :
+       { StructuringElement::rect(3, 3), StructuringElement::rect(4, 2),
+         StructuringElement::vertical(12), StructuringElement::rect(1, 1) }) {
+    const auto opened = opening(image, element);
+    const auto closed = closing(image, element);
+    REQUIRE(equal(opened, dilate(erode(image, element), element)));
+    REQUIRE(equal(closed, erode(dilate(image, element), element)));
+    // Both are idempotent, also for even sizes
+    REQUIRE(equal(opening(opened, element), opened));
+    REQUIRE(equal(closing(closed, element), closed));
+  }
+}
+
+TEST_CASE("Opening removes specks and closing fills gaps", "[morphology]") {
+  Mat<uint8_t> edges({ 9, 20, 1 });
+  for (unsigned x = 2; x < 18; ++x) {
+    edges[4][x][0] = x == 10 ? 0 : 255;
+  }
+  edges[1][1][0] = 255;
+
+  const auto closed = closing(edges, StructuringElement::horizontal(3));
+  REQUIRE(closed[4][10][0] == 255);
+  REQUIRE(closed[4][2][0] == 255);
+  REQUIRE(closed[4][1][0] == 0);
+
+  const auto opened = opening(edges, StructuringElement::horizontal(3));
+  REQUIRE(opened[1][1][0] == 0);
+  REQUIRE(opened[4][5][0] == 255);
+}
+
+TEST_CASE("Morphology reads strided views", "[morphology]") {
+  const auto image = noise(20, 30, 1);
+  const auto view = Mat<uint8_t>::borrow(const_cast<uint8_t*>(image.data()),
+                                         { 10, 15, 1 }, { 60, 2, 1 });
+  const auto element = StructuringElement::rect(3, 5);
+  REQUIRE(equal(erode(view, element),
+                bruteForce(Mat<uint8_t>(view), element, false)));
+}
+
+TEST_CASE("Morphology rejects empty elements", "[morphology]") {
+  REQUIRE_THROWS_AS(dilate(noise(4, 4, 1), StructuringElement::rect(0, 3)),
+                    std::invalid_argument);
+}
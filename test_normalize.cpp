@@ -0,0 +1,71 @@
+#include <cmath>
+#include <vector>
+
+#include "catch.hpp"
+#include "normalize.hpp"
+
+TEST_CASE("minMax finds extrema in one pass", "[normalize]") {
+  Mat<double> d({ 3, 7 },
+                [](unsigned i) -> double { return (i * 7) % 11 - 4.5; });
+  const auto [lo, hi] = minMax(d);
+  REQUIRE(lo == -4.5);
+  REQUIRE(hi == 5.5);
+
+  Mat<uint8_t> u({ 1000 }, [](unsigned i) -> uint8_t { return 3 + i % 200; });
+  REQUIRE(minMax(u, true) == std::pair<uint8_t, uint8_t>(3, 202));
+}
+
+TEST_CASE("Parallel minMax merges its chunks", "[normalize]") {
+  // Several 1 << 16 grains, with the extrema in different chunks and off
+  // the SIMD lane boundaries
+  const size_t n = (size_t(1) << 18) + 13;
+  Mat<uint8_t> u({ unsigned(n) }, [](unsigned i) -> uint8_t {
+    return 10 + (i * 2654435761u >> 24) % 200;
+  });
+  u.data()[n - 1] = 2;
+  u.data()[(size_t(1) << 17) + 5] = 251;
+  REQUIRE(minMax(u, true) == std::pair<uint8_t, uint8_t>(2, 251));
+  REQUIRE(minMax(u, true) == minMax(u, false));
+
+  Mat<double> d({ unsigned(n) },
+                [](unsigned i) -> double { return std::sin(i * 0.001); });
+  d.data()[3] = -7.25;
+  d.data()[n - 2] = 9.5;
+  REQUIRE(minMax(d, true) == std::pair<double, double>(-7.25, 9.5));
+}
+
+TEST_CASE("normalize maps the range onto the target range", "[normalize]") {
+  Mat<double> d({ 5 }, { -2, 0, 2, 4, 6 });
+  normalize<double>(d, 0, 255);
+  REQUIRE(d(0) == 0);
+  REQUIRE(d(2) == Approx(127.5));
+  REQUIRE(d(4) == 255);
+
+  Mat<double> constant({ 3 }, { 7, 7, 7 });
+  auto u = normalizeTo<uint8_t>(constant, 10, 20);
+  REQUIRE(u(0) == 10);
+  REQUIRE(u(2) == 10);
+}
+
+TEST_CASE("minMax and normalize honour strides", "[normalize]") {
+  // 2 x 3 view with a row pitch of 5; the padding holds values outside
+  // the view's range
+  std::vector<double> frame = { 1, 2, 3, -100, 100,  //
+                                4, 5, 6, -100, 100 };
+  auto view = Mat<double>::borrow(frame.data(), { 2, 3 }, { 5, 1 });
+  REQUIRE(!view.isContiguous());
+  REQUIRE(minMax(view) == std::pair<double, double>(1, 6));
+
+  const auto bytes = normalizeTo<uint8_t>(view, 0, 250);
+  REQUIRE(bytes.isContiguous());
+  REQUIRE(bytes[0][0] == 0);
+  REQUIRE(bytes[0][2] == 100);
+  REQUIRE(bytes[1][2] == 250);
+
+  normalize<double>(view, 0, 10);
+  REQUIRE(frame[0] == 0);
+  REQUIRE(frame[6] == Approx(8));
+  REQUIRE(frame[7] == 10);
+  REQUIRE(frame[9] == 100);
+  REQUIRE(frame[3] == -100);
+}
@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "preview.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+std::vector<uint8_t> readBytes(const std::string& name) {
+  std::ifstream file(name, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+}  // namespace
+
+TEST_CASE("PNGs decode from memory like from a file", "[png]") {
+  const auto image = noise(41, 23, 3);
+  const auto path = (std::filesystem::temp_directory_path() /
+                     "cpp-image-processing-decode.png")
+                        .string();
+  img::writePng(image, path);
+  const auto bytes = readBytes(path);
+  const auto fromFile = img::read(path);
+  std::remove(path.c_str());
+  const auto fromMemory = img::decode(bytes);
+  REQUIRE(fromMemory.shape() == fromFile.shape());
+  REQUIRE(std::equal(fromMemory.cbegin(), fromMemory.cend(),
+                     fromFile.cbegin()));
+  REQUIRE(std::equal(fromFile.cbegin(), fromFile.cend(), image.cbegin()));
+
+  // Truncation is reported by png_error() in the read callback, whose
+  // longjmp lands in the decoder rather than unwinding through libpng
+  const std::vector<uint8_t> truncated(bytes.begin(),
+                                       bytes.begin() + bytes.size() / 2);
+  REQUIRE_THROWS_AS(img::decode(truncated), std::runtime_error);
+  REQUIRE_THROWS(img::decode(bytes.data() + 1, bytes.size() - 1));
+
+  // A corrupt header chunk fails in open(), a corrupt IDAT while decoding
+  auto corrupt = bytes;
+  corrupt[16] ^= 0xff;
+  REQUIRE_THROWS_AS(img::decode(corrupt), std::runtime_error);
+  corrupt = bytes;
+  corrupt[bytes.size() - 20] ^= 0xff;
+  REQUIRE_THROWS_AS(img::decode(corrupt), std::runtime_error);
+}
+
+TEST_CASE("PNGs encode to memory without reallocating", "[png]") {
+  Mat<uint8_t> image({ 31, 17, 3 },
+                     [](unsigned i) -> uint8_t { return i * 13 + i / 7; });
+  const auto encoded = img::encode(image);
+  REQUIRE(encoded.size() > 8);
+
+  const auto decoded = img::decode(encoded);
+  REQUIRE(decoded.shape() == image.shape());
+  REQUIRE(std::equal(decoded.cbegin(), decoded.cend(), image.cbegin()));
+
+  // The stream fits the reservation, which the buffer's capacity shows was
+  // never outgrown: compressBound() of the samples plus a filter byte per
+  // row (2 * height + 7 for Adam7), 12 bytes per 8 KiB IDAT chunk and 1 KiB
+  // for the other chunks
+  const auto reservation = [](size_t samples, size_t rows) {
+    const size_t n = samples + rows;
+    const size_t deflated = n + (n >> 12) + (n >> 14) + (n >> 25) + 13;
+    return deflated + (deflated / 8192 + 1) * 12 + 1024;
+  };
+  const auto samples = noise(64, 64);
+  const auto reserved = img::encode(samples, PNG_COLOR_TYPE_GRAY);
+  REQUIRE(reserved.capacity() == reservation(64 * 64, 64));
+  const auto interlaced =
+      img::encode(samples, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_ADAM7);
+  REQUIRE(interlaced.capacity() == reservation(64 * 64, 2 * 64 + 7));
+
+  // Megabytes of incompressible samples, stored in many deflate blocks
+  const auto large = mixedNoise(1536, 1024, 3);
+  const auto stored = img::encode(large);
+  REQUIRE(stored.size() > large.size());
+  REQUIRE(stored.capacity() == reservation(large.size(), 1536));
+
+  REQUIRE_THROWS_AS(img::encode(samples, PNG_COLOR_TYPE_RGB),
+                    std::invalid_argument);
+}
+
+TEST_CASE("probe reports what read would return", "[png]") {
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto path = (dir / "cpp-image-processing-probe.png").string();
+  const auto rgb = noise(13, 19, 3);
+  img::writePng(rgb, path);
+  const auto info = img::probe(path);
+  const auto image = img::read(path);
+  REQUIRE(info.width == img::width(image));
+  REQUIRE(info.height == img::height(image));
+  REQUIRE(info.channels == img::channel(image));
+  REQUIRE(info.bitDepth == 8);
+  REQUIRE(!info.interlaced);
+  REQUIRE(info.bytes == image.size());
+  REQUIRE(info.allocatedBytes == MatPool::sizeClass(info.bytes));
+
+  img::ReadOptions gray;
+  gray.grayscale = true;
+  REQUIRE(img::probe(path, gray).channels == 1);
+
+  Mat<uint8_t> grayAlpha({ 5, 7, 2 });
+  img::write(grayAlpha, path, PNG_COLOR_TYPE_GRAY_ALPHA);
+  REQUIRE(img::probe(path).channels == 2);
+  REQUIRE(img::probe(path, gray).channels == 1);
+  REQUIRE(img::probe(path, gray).bytes == img::read(path, gray).size());
+  std::remove(path.c_str());
+
+  SECTION("PNM reads adopt their mapping") {
+    const auto pnm = (dir / "cpp-image-processing-probe.ppm").string();
+    img::write(rgb, pnm);
+    const auto mapped = img::probe(pnm);
+    REQUIRE(mapped.channels == 3);
+    REQUIRE(mapped.bytes == rgb.size());
+    REQUIRE(mapped.allocatedBytes == 0);
+    // Converting to grayscale allocates the converted image
+    const auto converted = img::probe(pnm, gray);
+    REQUIRE(converted.bytes == img::read(pnm, gray).size());
+    REQUIRE(converted.allocatedBytes == MatPool::sizeClass(converted.bytes));
+    std::remove(pnm.c_str());
+  }
+
+  SECTION("Raw files are refused like read refuses them") {
+    const auto raw = (dir / "cpp-image-processing-probe.raw").string();
+    img::write(rgb, raw);
+    REQUIRE_THROWS_AS(img::probe(raw), std::invalid_argument);
+    REQUIRE_THROWS_AS(img::read(raw), std::invalid_argument);
+    std::remove(raw.c_str());
+  }
+}
+
+TEST_CASE("Previews decode a reduced image", "[png]") {
+  const auto image = noise(37, 29, 3);
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto plain = (dir / "cpp-image-processing-preview.png").string();
+  const auto interlaced =
+      (dir / "cpp-image-processing-preview-adam7.png").string();
+  img::writePng(image, plain);
+  img::writePng(image, interlaced, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_ADAM7);
+  REQUIRE(img::probe(interlaced).interlaced);
+
+  SECTION("Adam7 passes are point-sampled") {
+    for (unsigned scale : { 2u, 4u, 8u }) {
+      const auto preview = img::readPreview(interlaced, scale);
+      REQUIRE(img::height(preview) == (37 + scale - 1) / scale);
+      REQUIRE(img::width(preview) == (29 + scale - 1) / scale);
+      for (unsigned y = 0; y < img::height(preview); ++y) {
+        for (unsigned x = 0; x < img::width(preview); ++x) {
+          for (unsigned c = 0; c < 3; ++c) {
+            REQUIRE(preview[y][x][c] == image[y * scale][x * scale][c]);
+          }
+        }
+      }
+    }
+  }
+
+  SECTION("Non-interlaced rows are box-averaged") {
+    const auto preview = img::readPreview(plain, 4);
+    REQUIRE(img::height(preview) == 10);
+    REQUIRE(img::width(preview) == 8);
+    for (unsigned y = 0; y < 10; ++y) {
+      for (unsigned x = 0; x < 8; ++x) {
+        unsigned sum = 0, count = 0;
+        for (unsigned dy = y * 4; dy < std::min(y * 4 + 4, 37u); ++dy) {
+          for (unsigned dx = x * 4; dx < std::min(x * 4 + 4, 29u); ++dx) {
+            sum += image[dy][dx][1];
+            ++count;
+          }
+        }
+        REQUIRE(preview[y][x][1] == (sum + count / 2) / count);
+      }
+    }
+  }
+
+  SECTION("Odd scales and grayscale apply to both layouts") {
+    img::ReadOptions gray;
+    gray.grayscale = true;
+    const auto fromPlain = img::readPreview(plain, 3, gray);
+    const auto fromInterlaced = img::readPreview(interlaced, 3, gray);
+    REQUIRE(img::channel(fromPlain) == 1);
+    REQUIRE(fromPlain.shape() == fromInterlaced.shape());
+    REQUIRE(std::equal(fromPlain.cbegin(), fromPlain.cend(),
+                       fromInterlaced.cbegin()));
+  }
+
+  std::remove(plain.c_str());
+  std::remove(interlaced.c_str());
+}
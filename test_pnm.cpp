@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include "catch.hpp"
+#include "img.hpp"
+
+namespace {
+std::string tempPath(const std::string& file) {
+  return (std::filesystem::temp_directory_path() / file).string();
+}
+}  // namespace
+
+TEST_CASE("PNM and raw files round-trip", "[pnm]") {
+  Mat<uint8_t> rgb({ 3, 5, 3 }, [](unsigned i) -> uint8_t { return i * 7; });
+  Mat<uint8_t> gray({ 4, 2, 1 }, [](unsigned i) -> uint8_t { return 255 - i; });
+
+  for (const auto& [image, name] :
+       { std::make_pair(&rgb, tempPath("cpp-image-processing-test.ppm")),
+         std::make_pair(&gray, tempPath("cpp-image-processing-test.PGM")) }) {
+    img::write(*image, name);
+    const auto back = img::read(name);
+    REQUIRE(back.shape() == image->shape());
+    REQUIRE(std::equal(back.cbegin(), back.cend(), image->cbegin()));
+    std::remove(name.c_str());
+  }
+
+  const auto raw = tempPath("cpp-image-processing-test.raw");
+  img::write(rgb, raw);
+  const auto back = img::readRaw(raw, 3, 5, 3);
+  REQUIRE(std::equal(back.cbegin(), back.cend(), rgb.cbegin()));
+  REQUIRE_THROWS(img::readRaw(raw, 3, 5, 1));
+  std::remove(raw.c_str());
+}
+
+TEST_CASE("Strided PNMs are written run by run", "[pnm]") {
+  // More rows than one writev() call takes buffers
+  const unsigned rows = 1500;
+  std::vector<uint8_t> frame(rows * 5);
+  for (size_t i = 0; i < frame.size(); ++i) {
+    frame[i] = uint8_t(i * 31);
+  }
+  const auto view =
+      Mat<uint8_t>::borrow(frame.data(), { rows, 3, 1 }, { 5, 1, 1 });
+  const auto name = tempPath("cpp-image-processing-strided.pgm");
+  img::write(view, name);
+  const auto back = img::read(name);
+  std::remove(name.c_str());
+  REQUIRE(back.shape() == view.shape());
+  for (unsigned y = 0; y < rows; ++y) {
+    for (unsigned x = 0; x < 3; ++x) {
+      REQUIRE(back[y][x][0] == frame[y * 5 + x]);
+    }
+  }
+}
+
+TEST_CASE("PNM headers with comments parse", "[pnm]") {
+  const char file[] = "P5\n# comment\n2 # width\n 1\n255\n\x01\x02";
+  const auto header = pnm::parseHeader(
+      reinterpret_cast<const uint8_t*>(file), sizeof(file) - 1);
+  REQUIRE(header.width == 2);
+  REQUIRE(header.height == 1);
+  REQUIRE(header.channels == 1);
+  REQUIRE(file[header.dataOffset] == '\x01');
+
+  const char truncated[] = "P6 4 4 255\n\x01";
+  REQUIRE_THROWS(pnm::parseHeader(reinterpret_cast<const uint8_t*>(truncated),
+                                  sizeof(truncated) - 1));
+
+  // Samples would need rescaling to 0..255
+  const char fourBit[] = "P5 2 1 15\n\x0f\x07";
+  REQUIRE_THROWS_AS(pnm::parseHeader(reinterpret_cast<const uint8_t*>(fourBit),
+                                     sizeof(fourBit) - 1),
+                    std::runtime_error);
+}
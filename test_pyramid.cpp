@@ -0,0 +1,78 @@
+#include <cmath>
+
+#include "catch.hpp"
+#include "convolute.hpp"
+#include "img.hpp"
+#include "pyramid.hpp"
+#include "test_fixtures.hpp"
+
+TEST_CASE("Pyramid levels match blur then decimate", "[pyramid]") {
+  for (unsigned channels : { 1u, 3u }) {
+    const auto image = noise(23, 18, channels);
+    ImagePyramid pyramid(image);
+    REQUIRE(pyramid.levels() == 5);
+    REQUIRE(pyramid[1].shape() == std::vector<size_t>{ 12, 9, channels });
+    REQUIRE(pyramid[4].shape() == std::vector<size_t>{ 2, 2, channels });
+    REQUIRE(std::equal(image.cbegin(), image.cend(), pyramid[0].cbegin()));
+
+    const Mat<double> kernal({ 5, 5 }, [](unsigned i) -> double {
+      const double taps[] = { 1, 4, 6, 4, 1 };
+      return taps[i / 5] * taps[i % 5] / 256;
+    });
+    for (unsigned level = 1; level < pyramid.levels(); ++level) {
+      const auto& source = pyramid[level - 1];
+      const auto blurred = convolute<uint8_t, double>(source, kernal);
+      const auto& reduced = pyramid[level];
+      for (unsigned y = 0; y < img::height(reduced); ++y) {
+        for (unsigned x = 0; x < img::width(reduced); ++x) {
+          for (unsigned c = 0; c < channels; ++c) {
+            const double expected = blurred[y * 2][x * 2][c];
+            REQUIRE(reduced[y][x][c] == std::floor(expected + 0.5));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Pyramid levels share one allocation", "[pyramid]") {
+  Mat<uint8_t> image({ 64, 40, 1 });
+  ImagePyramid pyramid(image, 3);
+  REQUIRE(pyramid.levels() == 3);
+  const uint8_t* first = pyramid[0].data();
+  REQUIRE(pyramid[1].data() >= first + image.size());
+  REQUIRE(pyramid[2].data() >= pyramid[1].data() + pyramid[1].size());
+  REQUIRE(pyramid[2].data() - first < 64 * 40 * 2);
+
+  ImagePyramid moved = std::move(pyramid);
+  REQUIRE(moved[0].data() == first);
+  REQUIRE_THROWS(moved.level(3));
+}
+
+TEST_CASE("pyramidDown checks its output", "[pyramid]") {
+  const auto image = noise(9, 6, 3);
+  auto output = Mat<uint8_t>::uninitialized({ 5, 3, 3 });
+  pyramidDown(image, output);
+
+  auto wrong = Mat<uint8_t>::uninitialized({ 4, 3, 3 });
+  REQUIRE_THROWS_AS(pyramidDown(image, wrong), std::invalid_argument);
+  wrong = Mat<uint8_t>::uninitialized({ 5, 3, 1 });
+  REQUIRE_THROWS_AS(pyramidDown(image, wrong), std::invalid_argument);
+
+  // Rows with a gap between them are rejected, not written past
+  std::vector<uint8_t> frame(5 * 12 * 3);
+  auto padded = Mat<uint8_t>::borrow(frame.data(), { 5, 3, 3 }, { 36, 3, 1 });
+  REQUIRE_THROWS_AS(pyramidDown(image, padded), std::invalid_argument);
+
+  // A strided input is copied first
+  std::vector<uint8_t> source(9 * 8 * 3);
+  for (unsigned y = 0; y < 9; ++y) {
+    for (unsigned i = 0; i < 6 * 3; ++i) {
+      source[y * 24 + i] = image.data()[y * 18 + i];
+    }
+  }
+  auto strided = Mat<uint8_t>::borrow(source.data(), { 9, 6, 3 }, { 24, 3, 1 });
+  auto fromStrided = Mat<uint8_t>::uninitialized({ 5, 3, 3 });
+  pyramidDown(strided, fromStrided);
+  REQUIRE(std::equal(output.cbegin(), output.cend(), fromStrided.cbegin()));
+}
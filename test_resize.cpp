@@ -0,0 +1,97 @@
+#include <cmath>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "resize.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+// Straightforward bilinear sample with replicated borders
+double bilinear(const Mat<float>& image, double y, double x, unsigned c) {
+  const auto at = [&](double yy, double xx) -> double {
+    const int h = img::height(image), w = img::width(image);
+    return image[std::clamp(int(yy), 0, h - 1)][std::clamp(int(xx), 0, w - 1)]
+                [c];
+  };
+  y = std::max(0.0, y);
+  x = std::max(0.0, x);
+  const double fy = y - std::floor(y), fx = x - std::floor(x);
+  const double y0 = std::floor(y), x0 = std::floor(x);
+  return (1 - fy) * ((1 - fx) * at(y0, x0) + fx * at(y0, x0 + 1)) +
+         fy * ((1 - fx) * at(y0 + 1, x0) + fx * at(y0 + 1, x0 + 1));
+}
+}  // namespace
+
+TEST_CASE("Resizing to the same size is exact", "[resize]") {
+  const auto image = noise(13, 11, 3);
+  for (auto mode : { img::Interpolation::NEAREST,
+                     img::Interpolation::BILINEAR,
+                     img::Interpolation::AREA }) {
+    const auto same = img::resize(image, 13, 11, mode);
+    REQUIRE(equal(same, image));
+  }
+}
+
+TEST_CASE("Nearest neighbour picks the covering pixel", "[resize]") {
+  const auto image = noise(5, 7, 4);
+  const auto larger = img::resize(image, 10, 21, img::Interpolation::NEAREST);
+  for (unsigned y = 0; y < 10; ++y) {
+    for (unsigned x = 0; x < 21; ++x) {
+      for (unsigned c = 0; c < 4; ++c) {
+        REQUIRE(larger[y][x][c] == image[y / 2][x / 3][c]);
+      }
+    }
+  }
+}
+
+TEST_CASE("Bilinear matches a direct evaluation", "[resize]") {
+  const auto image = noise(9, 12, 1).convertTo<float>();
+  const auto resized = img::resize(image, 14, 5);
+  for (unsigned y = 0; y < 14; ++y) {
+    for (unsigned x = 0; x < 5; ++x) {
+      const double expected = bilinear(image, (y + 0.5) * 9 / 14 - 0.5,
+                                       (x + 0.5) * 12 / 5 - 0.5, 0);
+      REQUIRE(resized[y][x][0] == Approx(expected).margin(1e-3));
+    }
+  }
+
+  // The fixed-point path stays within rounding of the float one
+  const auto fixed = img::resize(noise(9, 12, 1), 14, 5);
+  for (unsigned i = 0; i < fixed.size(); ++i) {
+    REQUIRE(std::abs(fixed(i) - resized(i)) <= 1.0f);
+  }
+}
+
+TEST_CASE("Area averaging shrinks by block means", "[resize]") {
+  const auto image = noise(12, 9, 1).convertTo<float>();
+  const auto shrunk = img::resize(image, 4, 3, img::Interpolation::AREA);
+  for (unsigned y = 0; y < 4; ++y) {
+    for (unsigned x = 0; x < 3; ++x) {
+      double sum = 0;
+      for (unsigned dy = 0; dy < 3; ++dy) {
+        for (unsigned dx = 0; dx < 3; ++dx) {
+          sum += image[y * 3 + dy][x * 3 + dx][0];
+        }
+      }
+      REQUIRE(shrunk[y][x][0] == Approx(sum / 9).margin(1e-3));
+    }
+  }
+}
+
+TEST_CASE("Channels are resized independently", "[resize]") {
+  for (unsigned channels : { 2u, 3u, 4u }) {
+    const auto image = noise(17, 23, channels);
+    const auto resized = img::resize(image, 7, 10, img::Interpolation::AREA);
+    for (unsigned c = 0; c < channels; ++c) {
+      Mat<uint8_t> plane({ 17, 23, 1 });
+      for (unsigned i = 0; i < plane.size(); ++i) {
+        plane(i, image(i * channels + c));
+      }
+      const auto single = img::resize(plane, 7, 10, img::Interpolation::AREA);
+      for (unsigned i = 0; i < single.size(); ++i) {
+        REQUIRE(resized(i * channels + c) == single(i));
+      }
+    }
+  }
+  REQUIRE_THROWS(img::resize(noise(4, 4, 1), 0, 4));
+}
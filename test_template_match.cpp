@@ -0,0 +1,107 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "catch.hpp"
+#include "img.hpp"
+#include "template_match.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+Mat<uint8_t> crop(const Mat<uint8_t>& image,
+                  unsigned top,
+                  unsigned left,
+                  unsigned height,
+                  unsigned width) {
+  Mat<uint8_t> patch({ height, width, 1 });
+  for (unsigned y = 0; y < height; ++y) {
+    for (unsigned x = 0; x < width; ++x) {
+      patch[y][x][0] = image[top + y][left + x][0];
+    }
+  }
+  return patch;
+}
+
+double bruteForceNcc(const Mat<uint8_t>& image,
+                     const Mat<uint8_t>& templ,
+                     unsigned top,
+                     unsigned left) {
+  const unsigned rows = img::height(templ), cols = img::width(templ);
+  double imageMean = 0, templMean = 0;
+  for (unsigned y = 0; y < rows; ++y) {
+    for (unsigned x = 0; x < cols; ++x) {
+      imageMean += image[top + y][left + x][0];
+      templMean += templ[y][x][0];
+    }
+  }
+  imageMean /= rows * cols;
+  templMean /= rows * cols;
+  double cross = 0, imageEnergy = 0, templEnergy = 0;
+  for (unsigned y = 0; y < rows; ++y) {
+    for (unsigned x = 0; x < cols; ++x) {
+      const double a = image[top + y][left + x][0] - imageMean;
+      const double b = templ[y][x][0] - templMean;
+      cross += a * b;
+      imageEnergy += a * a;
+      templEnergy += b * b;
+    }
+  }
+  return cross / std::sqrt(imageEnergy * templEnergy);
+}
+}  // namespace
+
+TEST_CASE("NCC scores match the definition", "[template]") {
+  const auto image = mixedNoise(40, 50);
+  const auto templ = mixedNoise(7, 9);
+  const auto scores = matchTemplate(image, templ);
+  REQUIRE(img::height(scores) == 34);
+  REQUIRE(img::width(scores) == 42);
+  for (unsigned y = 0; y < 34; y += 3) {
+    for (unsigned x = 0; x < 42; x += 5) {
+      REQUIRE(scores[y][x][0] ==
+              Approx(bruteForceNcc(image, templ, y, x)).margin(1e-5));
+    }
+  }
+}
+
+TEST_CASE("Template matching finds the patch", "[template]") {
+  const auto image = mixedNoise(60, 80);
+  // Same patch with different brightness and contrast
+  auto templ = crop(image, 23, 41, 11, 8);
+  for (auto& value : templ) {
+    value = uint8_t(value / 2 + 20);
+  }
+  const auto scores = matchTemplate(image, templ);
+  const auto matches = bestMatches(scores, 3, 5);
+  REQUIRE(matches.size() == 3);
+  REQUIRE(matches[0].x == 41);
+  REQUIRE(matches[0].y == 23);
+  REQUIRE(matches[0].score == Approx(1).margin(0.01));
+  REQUIRE(matches[1].score < matches[0].score);
+  for (const auto& match : matches) {
+    if (&match != &matches[0]) {
+      REQUIRE(std::max(std::abs(int(match.x) - 41),
+                       std::abs(int(match.y) - 23)) >= 5);
+    }
+  }
+}
+
+TEST_CASE("Flat windows and templates score 0", "[template]") {
+  Mat<uint8_t> image({ 20, 20, 1 }, [](unsigned) -> uint8_t { return 7; });
+  image[10][10][0] = 200;
+  const auto scores = matchTemplate(image, mixedNoise(3, 3));
+  REQUIRE(scores[0][0][0] == 0);
+  REQUIRE(scores[9][9][0] != 0);
+
+  const auto flat =
+      matchTemplate(mixedNoise(10, 10), Mat<uint8_t>({ 3, 3, 1 }));
+  REQUIRE(std::all_of(flat.cbegin(), flat.cend(),
+                      [](float score) { return score == 0; }));
+}
+
+TEST_CASE("Template matching rejects bad inputs", "[template]") {
+  REQUIRE_THROWS_AS(matchTemplate(mixedNoise(5, 5), mixedNoise(6, 2)),
+                    std::invalid_argument);
+  REQUIRE_THROWS_AS(
+      matchTemplate(Mat<uint8_t>({ 5, 5, 3 }), mixedNoise(2, 2)),
+      std::invalid_argument);
+}
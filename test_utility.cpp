@@ -20,3 +20,12 @@ TEST_CASE("findDirection works", "[utility]") {
   REQUIRE(findDirection(3 * M_PI_4) == Direction::TOP_LEFT);
   REQUIRE(findDirection(-3 * M_PI_4) == Direction::BOTTOM_LEFT);
 }
+
+TEST_CASE("mirror reflects without repeating the border", "[utility]") {
+  REQUIRE(mirror(0, 5) == 0);
+  REQUIRE(mirror(4, 5) == 4);
+  REQUIRE(mirror(-1, 5) == 1);
+  REQUIRE(mirror(-2, 5) == 2);
+  REQUIRE(mirror(5, 5) == 3);
+  REQUIRE(mirror(6, 5) == 2);
+}
@@ -1,7 +1,18 @@
 #pragma once
 #include <cmath>
+#include <cstdlib>
 #include "assertions.hpp"
 
+/**
+ * Reflects an index that is at most one kernel radius outside [0, end) back
+ * into it without repeating the border sample: -1 maps to 1 and `end` to
+ * end - 2. This is the border rule of convolute() and the filters that
+ * mirror it.
+ */
+inline int mirror(int index, int end) {
+  return index > end - 1 ? 2 * (end - 1) - index : std::abs(index);
+}
+
 enum class Direction {
   TOP_LEFT,
   TOP,